@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+#include "parser.h"
+#include "myshell.h"
+
+// msh_bench [-n muestras] [filtro]
+//
+// Microbenchmarks de los caminos calientes de la shell. Cada prueba toma
+// varias muestras (tras unas de calentamiento que se descartan) y se informa
+// de sus percentiles en JSON por la salida estandar, para poder comparar
+// versiones. Con filtro solo se ejecutan las pruebas cuyo nombre lo contiene.
+// Las de spawn con cientos de MiB residentes solo se ejecutan con un filtro que
+// las incluya (p. ej. "rss_1024m").
+
+#define CALENTAMIENTO 5
+
+static int muestras = 200;
+static const char* filtro = NULL;
+static int primera = 1;
+
+static double ahora_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int comparar_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentil(const double* v, int n, double p) {
+    int i = (int)(p / 100.0 * (n - 1) + 0.5);
+    return v[i];
+}
+
+static int elegida(const char* nombre) {
+    return filtro == NULL || strstr(nombre, filtro) != NULL;
+}
+
+static int elegida_con_filtro(const char* nombre) {
+    return filtro != NULL && strstr(nombre, filtro) != NULL;
+}
+
+// Una entrada del array "pruebas". extra es JSON ya formateado o NULL
+static void emitir(const char* nombre, const char* unidad, double* v, int n, const char* extra) {
+    qsort(v, n, sizeof(double), comparar_double);
+    double suma = 0;
+    for (int i = 0; i < n; i++) suma += v[i];
+
+    printf("%s\n    {\"nombre\": \"%s\", \"unidad\": \"%s\", \"muestras\": %d, "
+           "\"min\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"media\": %.3f",
+           primera ? "" : ",", nombre, unidad, n, v[0], percentil(v, n, 50), percentil(v, n, 90),
+           percentil(v, n, 99), v[n - 1], suma / n);
+    if (extra) printf(", %s", extra);
+    printf("}");
+    fflush(stdout);
+    primera = 0;
+}
+
+// tokenize: cada muestra es el tiempo medio de un lote de llamadas
+
+static void bench_tokenize(const char* nombre, const char* linea, int lote) {
+    if (!elegida(nombre)) return;
+    char* copia = strdup(linea);
+    double* v = malloc(muestras * sizeof(double));
+
+    for (int m = -CALENTAMIENTO; m < muestras; m++) {
+        double t0 = ahora_ns();
+        for (int i = 0; i < lote; i++) {
+            tokenize(copia);
+        }
+        double t = (ahora_ns() - t0) / lote;
+        if (m >= 0) v[m] = t;
+    }
+
+    char extra[128];
+    qsort(v, muestras, sizeof(double), comparar_double);
+    snprintf(extra, sizeof(extra), "\"bytes\": %zu, \"mb_s_p50\": %.1f",
+             strlen(linea), strlen(linea) / percentil(v, muestras, 50) * 1e3);
+    emitir(nombre, "ns", v, muestras, extra);
+    free(v);
+    free(copia);
+}
+
+// Lanzamiento y espera de una linea completa con lanzar_pipeline
+
+// Devuelve el tiempo total y, en montaje, el de lanzar todas las etapas
+static double ejecutar_y_esperar(tline* linea, double* montaje) {
+    pid_t* pids = malloc(linea->ncommands * sizeof(pid_t));
+
+    // En modo adaptativo se espera como la shell sin bucle de eventos
+    double t0 = ahora_ns();
+    vigilar_tuberias = 1;
+    int lanzados = lanzar_pipeline(linea, 0, pids, NULL);
+    vigilar_tuberias = 0;
+    if (montaje) *montaje = ahora_ns() - t0;
+    for (int i = 0; i < lanzados; i++) {
+        if (tuberias_vigiladas()) {
+            int estatus;
+            esperar_muestreando(pids[i], &estatus, NULL);
+        } else {
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+    soltar_tuberias();
+    double t = ahora_ns() - t0;
+    free(pids);
+    return t;
+}
+
+static void bench_linea(const char* nombre, const char* texto, int n_muestras) {
+    if (!elegida(nombre)) return;
+    char* copia = strdup(texto);
+    tline* linea = copiar_tline(tokenize(copia));
+    double* v = malloc(n_muestras * sizeof(double));
+
+    for (int m = -CALENTAMIENTO; m < n_muestras; m++) {
+        double t = ejecutar_y_esperar(linea, NULL) / 1e3;
+        if (m >= 0) v[m] = t;
+    }
+    emitir(nombre, "us", v, n_muestras, NULL);
+    free(v);
+    liberar_tline(linea);
+    free(copia);
+}
+
+static void bench_spawn(const char* nombre, tModoSpawn modo) {
+    tModoSpawn anterior = modo_spawn;
+    modo_spawn = modo;
+    bench_linea(nombre, "true", muestras);
+    modo_spawn = anterior;
+}
+
+// Latencia de lanzamiento (sin la espera) de cada backend con la memoria de
+// la shell inflada a megas MiB, tocados para que sean residentes
+
+static long rss_kib() {
+    long paginas = 0, residentes = 0;
+    FILE* f = fopen("/proc/self/statm", "re");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &paginas, &residentes) != 2) residentes = 0;
+        fclose(f);
+    }
+    return residentes * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void bench_spawn_rss(int megas) {
+    static const tModoSpawn modos[] = {SPAWN_FORK, SPAWN_POSIX, SPAWN_ZYGOTE};
+    char nombres[3][64];
+    int elegidas[3];
+    int alguna = 0;
+    for (int i = 0; i < 3; i++) {
+        snprintf(nombres[i], sizeof(nombres[i]), "spawn_%s_rss_%dm", nombre_modo_spawn(modos[i]), megas);
+        // Sin filtro no se reservan cientos de MiB
+        elegidas[i] = megas ? elegida_con_filtro(nombres[i]) : elegida(nombres[i]);
+        alguna |= elegidas[i];
+    }
+    if (!alguna) return;
+
+    size_t bytes = (size_t)megas << 20;
+    char* globo = bytes ? malloc(bytes) : NULL;
+    if (globo) memset(globo, 1, bytes);
+    long rss = rss_kib();
+
+    char* copia = strdup("true");
+    tline* linea = copiar_tline(tokenize(copia));
+    double* v = malloc(muestras * sizeof(double));
+    double* total = malloc(muestras * sizeof(double));
+    tModoSpawn anterior = modo_spawn;
+    for (int i = 0; i < 3; i++) {
+        if (!elegidas[i]) continue;
+        modo_spawn = modos[i];
+        for (int m = -CALENTAMIENTO; m < muestras; m++) {
+            double montaje;
+            double t = ejecutar_y_esperar(linea, &montaje);
+            if (m >= 0) {
+                v[m] = montaje / 1e3;
+                total[m] = t / 1e3;
+            }
+        }
+        // Ademas del lanzamiento, el tiempo hasta recoger el hijo
+        char extra[96];
+        qsort(total, muestras, sizeof(double), comparar_double);
+        snprintf(extra, sizeof(extra), "\"rss_kib\": %ld, \"total_p50_us\": %.3f",
+                 rss, percentil(total, muestras, 50));
+        emitir(nombres[i], "us", v, muestras, extra);
+    }
+    modo_spawn = anterior;
+    free(v);
+    free(total);
+    liberar_tline(linea);
+    free(copia);
+    free(globo);
+}
+
+static void bench_pipeline(int etapas) {
+    char nombre[64];
+    char texto[512] = "true";
+    snprintf(nombre, sizeof(nombre), "pipeline_%d_etapas", etapas);
+    for (int i = 1; i < etapas; i++) strcat(texto, " | true");
+    bench_linea(nombre, texto, muestras);
+}
+
+// Montaje de pipelines largas: tiempo de lanzar todas las etapas, y cuanto
+// toca por etapa, segun el numero de etapas. Menos muestras cuanto mas larga
+
+static void bench_montaje(int etapas) {
+    char nombre[64];
+    snprintf(nombre, sizeof(nombre), "montaje_%d_etapas", etapas);
+    if (!elegida(nombre)) return;
+
+    char* texto = malloc(etapas * 7 + 1);
+    strcpy(texto, "true");
+    for (int i = 1; i < etapas; i++) strcat(texto, " | true");
+    tline* linea = copiar_tline(tokenize(texto));
+
+    int n = muestras * 8 / etapas;
+    if (n < 3) n = 3;
+    if (n > muestras) n = muestras;
+    double* v = malloc(n * sizeof(double));
+    double* desmontaje = malloc(n * sizeof(double));
+
+    for (int m = -1; m < n; m++) {
+        double montaje;
+        double total = ejecutar_y_esperar(linea, &montaje);
+        if (m >= 0) {
+            v[m] = montaje / 1e3;
+            desmontaje[m] = (total - montaje) / 1e3;
+        }
+    }
+
+    char extra[160];
+    qsort(v, n, sizeof(double), comparar_double);
+    qsort(desmontaje, n, sizeof(double), comparar_double);
+    snprintf(extra, sizeof(extra), "\"etapas\": %d, \"us_por_etapa_p50\": %.3f, \"espera_p50_us\": %.3f",
+             etapas, percentil(v, n, 50) / etapas, percentil(desmontaje, n, 50));
+    emitir(nombre, "us", v, n, extra);
+    free(v);
+    free(desmontaje);
+    liberar_tline(linea);
+    free(texto);
+}
+
+// Caudal de datos a traves de una pipeline: MB/s por muestra, con las pipes
+// del tamaño indicado (como pipesize)
+
+static void bench_caudal(const char* nombre, long bytes, int cats, const char* tam) {
+    if (!elegida(nombre)) return;
+    tTamPipe anterior = tam_pipe;
+    parsear_tam_pipe(tam, &tam_pipe);
+    char texto[512];
+    snprintf(texto, sizeof(texto), "head -c %ld /dev/zero", bytes);
+    for (int i = 0; i < cats; i++) strcat(texto, " | cat");
+    strcat(texto, " > /dev/null");
+
+    char* copia = strdup(texto);
+    tline* linea = copiar_tline(tokenize(copia));
+    int n = muestras / 10 > 3 ? muestras / 10 : 3;
+    double* v = malloc(n * sizeof(double));
+
+    for (int m = -1; m < n; m++) {
+        double t = ejecutar_y_esperar(linea, NULL);
+        if (m >= 0) v[m] = bytes / (t / 1e9) / 1e6;
+    }
+
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"bytes\": %ld, \"etapas\": %d, \"pipesize\": \"%s\"",
+             bytes, cats + 1, tam);
+    emitir(nombre, "MB/s", v, n, extra);
+    free(v);
+    liberar_tline(linea);
+    free(copia);
+    tam_pipe = anterior;
+}
+
+// Tabla de jobs: con `vivos` jobs ya dados de alta, cada operacion es un
+// alta, una busqueda por pgid, una por id y una baja
+
+static void bench_jobs(int vivos) {
+    char nombre[64];
+    snprintf(nombre, sizeof(nombre), "jobs_%d_vivos", vivos);
+    if (!elegida(nombre)) return;
+
+    // pgids ficticios muy por encima de los reales: nunca se les manda nada
+    const pid_t base = 1 << 28;
+    for (int i = 0; i < vivos; i++) {
+        pid_t pgid = base + i;
+        add_job(pgid, getSiguienteId(), "bench", &pgid, 1);
+    }
+
+    const int lote = 1000;
+    double* v = malloc(muestras * sizeof(double));
+    pid_t siguiente = base + vivos;
+    for (int m = -CALENTAMIENTO; m < muestras; m++) {
+        double t0 = ahora_ns();
+        for (int i = 0; i < lote; i++) {
+            pid_t pgid = siguiente++;
+            tJob* job = add_job(pgid, getSiguienteId(), "bench", &pgid, 1);
+            getJobxPgid(base + i % vivos);
+            getJobxId(job->id);
+            pid_olvidar(pgid);
+            removeJob(job);
+        }
+        double t = (ahora_ns() - t0) / lote;
+        if (m >= 0) v[m] = t;
+    }
+    emitir(nombre, "ns", v, muestras, NULL);
+    free(v);
+    liberar_jobs();
+}
+
+// Historial: un fichero sintetico de `entradas` lineas (una de cada cuatro
+// repetida). Se mide el indexado completo y busquedas desde la mas reciente
+
+static void bench_historial(int entradas) {
+    char nombre[64];
+    snprintf(nombre, sizeof(nombre), "historial_%d", entradas);
+    if (!elegida(nombre)) return;
+
+    char ruta[] = "/tmp/msh_bench_historialXXXXXX";
+    int fd = mkstemp(ruta);
+    FILE* f = fdopen(fd, "w");
+    const char* plantillas[] = {"ssh host%d.example.com", "grep -rn patron%d src/",
+                                "kubectl get pods -n ns%d", "make -j8 objetivo%d", "vim fichero%d.c"};
+    srand(1);
+    for (int i = 0; i < entradas; i++) {
+        fprintf(f, plantillas[i % 5], i % 4 == 3 ? i - 3 : i);
+        fputc('\n', f);
+    }
+    fclose(f);
+
+    historial_abrir(ruta);
+    double t0 = ahora_ns();
+    while (historial_indexar(1 << 30)) {
+    }
+    double indexado = (ahora_ns() - t0) / 1e6;
+
+    struct { const char* sufijo; const char* texto; int prefijo; } consultas[] = {
+        {"raro", "host12", 0},          // pocas lineas, antiguas
+        {"comun", "kubectl", 0},        // la mitad de las recientes
+        {"ausente", "no-existe", 0},
+        {"prefijo", "vim fichero1", 1},
+    };
+    for (size_t c = 0; c < sizeof(consultas) / sizeof(consultas[0]); c++) {
+        char sub[96];
+        snprintf(sub, sizeof(sub), "%s_%s", nombre, consultas[c].sufijo);
+        double* v = malloc(muestras * sizeof(double));
+        for (int m = -CALENTAMIENTO; m < muestras; m++) {
+            double t1 = ahora_ns();
+            historial_buscar(consultas[c].texto, historial_total(), consultas[c].prefijo);
+            double t = ahora_ns() - t1;
+            if (m >= 0) v[m] = t;
+        }
+        char extra[128];
+        snprintf(extra, sizeof(extra), "\"entradas\": %d, \"indexado_ms\": %.1f", entradas, indexado);
+        emitir(sub, "ns", v, muestras, extra);
+        free(v);
+    }
+    unlink(ruta);
+}
+
+// Completado de comandos: leer todo PATH (lo que cuesta cada Tab si no hay
+// indice) frente a una consulta de prefijo sobre el indice
+
+static void bench_completado() {
+    if (!elegida("completado")) return;
+
+    int n = muestras / 10 > 3 ? muestras / 10 : 3;
+    double* v = malloc((n > muestras ? n : muestras) * sizeof(double));
+    for (int m = -1; m < n; m++) {
+        completado_invalidar();
+        double t0 = ahora_ns();
+        completado_actualizar();
+        if (m >= 0) v[m] = (ahora_ns() - t0) / 1e3;
+    }
+    int primero;
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"comandos\": %d", completado_buscar("", &primero));
+    emitir("completado_leer_path", "us", v, n, extra);
+
+    const char* prefijos[] = {"g", "py", "ls"};
+    for (int p = 0; p < 3; p++) {
+        char nombre[64];
+        snprintf(nombre, sizeof(nombre), "completado_prefijo_%s", prefijos[p]);
+        int coincidencias = 0;
+        for (int m = -CALENTAMIENTO; m < muestras; m++) {
+            double t0 = ahora_ns();
+            coincidencias = completado_buscar(prefijos[p], &primero);
+            double t = ahora_ns() - t0;
+            if (m >= 0) v[m] = t;
+        }
+        snprintf(extra, sizeof(extra), "\"coincidencias\": %d", coincidencias);
+        emitir(nombre, "ns", v, muestras, extra);
+    }
+    free(v);
+}
+
+// Despacho de internas: tokenize + busqueda en el diccionario + ejecucion
+
+static void bench_interna(const char* nombre, const char* texto, int lote) {
+    if (!elegida(nombre)) return;
+    char* copia = strdup(texto);
+    double* v = malloc(muestras * sizeof(double));
+
+    for (int m = -CALENTAMIENTO; m < muestras; m++) {
+        double t0 = ahora_ns();
+        for (int i = 0; i < lote; i++) {
+            manejador_internas(tokenize(copia));
+        }
+        double t = (ahora_ns() - t0) / lote;
+        if (m >= 0) v[m] = t;
+    }
+    emitir(nombre, "ns", v, muestras, NULL);
+    free(v);
+    free(copia);
+}
+
+// Bucle for: el cuerpo se tokeniza una vez y en cada vuelta solo se
+// sustituye la variable. Cada muestra es el tiempo medio por vuelta
+
+static void bench_bucle(const char* nombre, const char* cuerpo, int vueltas) {
+    if (!elegida(nombre)) return;
+    char texto[256];
+    snprintf(texto, sizeof(texto), "for i in {1..%d}; do %s; done", vueltas, cuerpo);
+    double* v = malloc(muestras * sizeof(double));
+
+    for (int m = -CALENTAMIENTO; m < muestras; m++) {
+        double t0 = ahora_ns();
+        bucle_linea(texto);
+        double t = (ahora_ns() - t0) / vueltas;
+        if (m >= 0) v[m] = t;
+    }
+    emitir(nombre, "ns", v, muestras, NULL);
+    free(v);
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            muestras = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && filtro == NULL) {
+            filtro = argv[i];
+        } else {
+            fprintf(stderr, "Uso: %s [-n muestras] [filtro]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (muestras < 1) {
+        fprintf(stderr, "-n necesita un numero positivo\n");
+        return 2;
+    }
+    shell_interactiva = 0;
+    hash_nueva_linea();
+    // Como la shell: el zygote se crea antes de que crezca la memoria
+    zygote_iniciar();
+
+    struct utsname sistema;
+    uname(&sistema);
+    printf("{\n  \"version\": 1, \"sistema\": \"%s %s %s\", \"cpus\": %ld, \"muestras\": %d,\n"
+           "  \"pruebas\": [", sistema.sysname, sistema.release, sistema.machine,
+           sysconf(_SC_NPROCESSORS_ONLN), muestras);
+
+    // Lineas de distinto tamaño para el tokenizador
+    char larga[64 * 1024 + 1];
+    for (int i = 0; i < 64 * 1024; i++) larga[i] = (i % 16 == 15) ? ' ' : 'a' + i % 26;
+    larga[64 * 1024] = '\0';
+    bench_tokenize("tokenize_corta", "ls -l /tmp", 10000);
+    bench_tokenize("tokenize_pipeline", "cat < entrada.txt | grep -v foo | sort -u | uniq -c | head -n 20 > salida.txt >& errores.txt &", 10000);
+    bench_tokenize("tokenize_64k", larga, 20);
+    // Con la traza activa cada llamada deja un evento en el anillo
+    if (elegida("tokenize_corta_traza") && traza_abrir("/dev/null") == 0) {
+        bench_tokenize("tokenize_corta_traza", "ls -l /tmp", 10000);
+        traza_cerrar();
+    }
+
+    bench_spawn("spawn_fork", SPAWN_FORK);
+    bench_spawn("spawn_posix", SPAWN_POSIX);
+    bench_spawn("spawn_zygote", SPAWN_ZYGOTE);
+    bench_spawn_rss(0);
+    bench_spawn_rss(256);
+    bench_spawn_rss(1024);
+    bench_pipeline(2);
+    bench_pipeline(4);
+    bench_pipeline(8);
+    bench_montaje(16);
+    bench_montaje(128);
+    bench_montaje(1024);
+    bench_montaje(4096);
+    bench_caudal("caudal_pipeline", 64L << 20, 2, "0");
+    bench_caudal("caudal_pipeline_256k", 64L << 20, 2, "256K");
+    bench_caudal("caudal_pipeline_1m", 64L << 20, 2, "1M");
+    bench_caudal("caudal_pipeline_auto", 64L << 20, 2, "auto");
+
+    bench_jobs(10);
+    bench_jobs(10000);
+
+    bench_historial(100000);
+    bench_completado();
+
+    bench_interna("interna_true", "true", 10000);
+    bench_interna("interna_echo_redirigido", "echo hola > /dev/null", 1000);
+    bench_bucle("bucle_true", "true", 10000);
+    bench_bucle("bucle_echo_redirigido", "echo $i > /dev/null", 1000);
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
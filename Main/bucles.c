@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "parser.h"
+#include "myshell.h"
+
+// Bucles for y while
+//
+//     for VAR in palabra... ; do linea ; ... ; done
+//     while linea ; ... ; do linea ; ... ; done
+//
+// Las partes se separan con ';' o con saltos de linea: en un script, en -c o
+// en el prompt un bucle puede ocupar varias lineas y no se ejecuta hasta su
+// done. Se pueden anidar. Entre las palabras del for, {a..b} es la secuencia
+// de enteros de a a b, que se recorre sin generarla en memoria.
+//
+// Antes de la primera vuelta cada linea del cuerpo se tokeniza una sola vez
+// (copia propia con copiar_tline) y se anotan los argv y redirecciones donde
+// aparece $VAR o ${VAR} de algun bucle que la rodea. En cada vuelta solo se
+// reescriben esos huecos con el valor actual: el coste del interprete por
+// vuelta es copiar unos bytes, no volver a trocear la linea. Un $NOMBRE que no
+// es variable de ningun bucle se deja tal cual.
+//
+// El estado del bucle es el de la ultima linea del cuerpo (0 si no se ejecuto
+// ninguna). Un comando que muere por SIGINT, o Ctrl-C en el prompt mientras
+// solo se ejecutan internas, corta todos los bucles.
+
+// Variable de un for. nombre y los valores literales apuntan al texto del bucle
+typedef struct tVariable {
+    const char* nombre;
+    size_t largo_nombre;
+    const char* valor;
+    size_t largo;
+    char numero[24];                // valor de la vuelta actual de {a..b}
+    struct tVariable* exterior;     // la del bucle que rodea a este
+} tVariable;
+
+// Trozo de una palabra: texto literal o el valor de una variable
+typedef struct {
+    const char* texto;
+    size_t largo;
+    tVariable* variable;            // NULL si es literal
+} tTrozo;
+
+typedef struct {
+    char** destino;                 // argv[i] o redireccion que se reescribe
+    int comando;                    // indice del comando si destino es su argv[0]
+    tTrozo* trozos;
+    int ntrozos;
+    char* buf;                      // palabra ya sustituida
+    size_t capacidad;
+} tHueco;
+
+// Palabra de la lista de un for
+typedef struct {
+    tHueco hueco;                   // sin destino
+    int es_rango;                   // {desde..hasta}
+    long desde, hasta;
+} tPalabra;
+
+typedef enum { B_LINEA, B_FOR, B_WHILE } tTipoSentencia;
+
+typedef struct tSentencia {
+    tTipoSentencia tipo;
+    struct tSentencia* siguiente;
+    // B_LINEA
+    tline* linea;
+    tcommand* original;             // comandos como los dejo tokenize (time y
+                                    // MSH_PIPE_SZ= los cambian al ejecutar)
+    tHueco* huecos;
+    int nhuecos;
+    // B_FOR
+    tVariable* variable;
+    tPalabra* palabras;
+    int npalabras;
+    // B_WHILE
+    struct tSentencia* condicion;
+    // B_FOR y B_WHILE
+    struct tSentencia* cuerpo;
+} tSentencia;
+
+typedef struct {
+    char** segmentos;
+    int n;
+    int i;
+    tVariable* variables;           // la del for mas interior que se esta leyendo
+    int error;
+} tAnalisis;
+
+static char* pendiente = NULL;      // lineas de un bucle sin cerrar, unidas con ';'
+static int interrumpido = 0;
+
+static int es_palabra(const char* s, const char* clave) {
+    size_t n = strlen(clave);
+    return strncmp(s, clave, n) == 0 && (s[n] == ' ' || s[n] == '\t' || s[n] == ';' || s[n] == '\0');
+}
+
+static char* saltar_blancos(char* s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+    return s;
+}
+
+// Trocea el texto (en el sitio) por ';' y saltos de linea. "do linea" son dos
+// segmentos: la palabra do y la linea
+static char** trocear_segmentos(char* texto, int* n) {
+    int capacidad = 16;
+    char** segmentos = malloc(capacidad * sizeof(char*));
+    *n = 0;
+    char* p = texto;
+    while (*p) {
+        char* fin = p + strcspn(p, ";\n");
+        char siguiente = *fin;
+        *fin = '\0';
+        char* s = saltar_blancos(p);
+        char* cola = s + strlen(s);
+        while (cola > s && (cola[-1] == ' ' || cola[-1] == '\t' || cola[-1] == '\r')) *--cola = '\0';
+        while (*s) {
+            if (*n + 2 > capacidad) {
+                capacidad *= 2;
+                segmentos = realloc(segmentos, capacidad * sizeof(char*));
+            }
+            if (!es_palabra(s, "do") || s[2] == '\0') {
+                segmentos[(*n)++] = s;
+                break;
+            }
+            s[2] = '\0';
+            segmentos[(*n)++] = s;
+            s = saltar_blancos(s + 3);
+        }
+        p = siguiente ? fin + 1 : fin;
+    }
+    return segmentos;
+}
+
+// Bucles abiertos al final del texto: for y while abren, done cierra
+static int profundidad(const char* texto) {
+    char* copia = strdup(texto);
+    int n;
+    char** segmentos = trocear_segmentos(copia, &n);
+    int abiertos = 0;
+    for (int i = 0; i < n; i++) {
+        if (es_palabra(segmentos[i], "for") || es_palabra(segmentos[i], "while")) abiertos++;
+        else if (strcmp(segmentos[i], "done") == 0) abiertos--;
+    }
+    free(segmentos);
+    free(copia);
+    return abiertos;
+}
+
+// Huecos
+
+static tVariable* buscar_variable(tVariable* v, const char* nombre, size_t largo) {
+    for (; v; v = v->exterior) {
+        if (v->largo_nombre == largo && strncmp(v->nombre, nombre, largo) == 0) {
+            return v;
+        }
+    }
+    return NULL;
+}
+
+static int es_nombre(char c, int primero) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (!primero && c >= '0' && c <= '9');
+}
+
+static void anadir_trozo(tHueco* h, const char* texto, size_t largo, tVariable* variable) {
+    if ((h->ntrozos & (h->ntrozos - 1)) == 0) {
+        h->trozos = realloc(h->trozos, (h->ntrozos ? h->ntrozos * 2 : 2) * sizeof(tTrozo));
+    }
+    h->trozos[h->ntrozos++] = (tTrozo){texto, largo, variable};
+}
+
+// Parte texto en literales y variables. Devuelve cuantas variables hay: sin
+// ninguna queda un solo trozo literal con todo el texto
+static int preparar_hueco(tHueco* h, const char* texto, tVariable* variables) {
+    int encontradas = 0;
+    const char* literal = texto;
+    const char* p = texto;
+    while ((p = strchr(p, '$')) != NULL) {
+        const char* nombre = p + 1;
+        int llaves = *nombre == '{';
+        if (llaves) nombre++;
+        size_t largo = 0;
+        while (es_nombre(nombre[largo], largo == 0)) largo++;
+        tVariable* v = largo ? buscar_variable(variables, nombre, largo) : NULL;
+        if (v == NULL || (llaves && nombre[largo] != '}')) {
+            p++;
+            continue;
+        }
+        if (p > literal) anadir_trozo(h, literal, p - literal, NULL);
+        anadir_trozo(h, NULL, 0, v);
+        encontradas++;
+        p = literal = nombre + largo + llaves;
+    }
+    if (*literal || h->ntrozos == 0) anadir_trozo(h, literal, strlen(literal), NULL);
+    return encontradas;
+}
+
+// Palabra con los valores actuales; *largo (si no es NULL) su longitud
+static char* expandir(tHueco* h, size_t* largo) {
+    if (h->ntrozos == 1 && h->trozos[0].variable == NULL) {
+        if (largo) *largo = h->trozos[0].largo;
+        return (char*)h->trozos[0].texto; // literal completo: ya acaba en '\0'
+    }
+    size_t total = 0;
+    for (int i = 0; i < h->ntrozos; i++) {
+        total += h->trozos[i].variable ? h->trozos[i].variable->largo : h->trozos[i].largo;
+    }
+    if (total + 1 > h->capacidad) {
+        h->capacidad = total + 1 > 2 * h->capacidad ? total + 1 : 2 * h->capacidad;
+        h->buf = realloc(h->buf, h->capacidad);
+    }
+    char* q = h->buf;
+    for (int i = 0; i < h->ntrozos; i++) {
+        const tTrozo* t = &h->trozos[i];
+        const char* texto = t->variable ? t->variable->valor : t->texto;
+        size_t n = t->variable ? t->variable->largo : t->largo;
+        memcpy(q, texto, n);
+        q += n;
+    }
+    *q = '\0';
+    if (largo) *largo = total;
+    return h->buf;
+}
+
+static void liberar_hueco(tHueco* h) {
+    free(h->trozos);
+    free(h->buf);
+}
+
+// Lectura
+
+static void liberar_sentencias(tSentencia* s) {
+    while (s) {
+        tSentencia* siguiente = s->siguiente;
+        if (s->linea) liberar_tline(s->linea);
+        free(s->original);
+        for (int i = 0; i < s->nhuecos; i++) liberar_hueco(&s->huecos[i]);
+        free(s->huecos);
+        for (int i = 0; i < s->npalabras; i++) liberar_hueco(&s->palabras[i].hueco);
+        free(s->palabras);
+        free(s->variable);
+        liberar_sentencias(s->condicion);
+        liberar_sentencias(s->cuerpo);
+        free(s);
+        s = siguiente;
+    }
+}
+
+static void error_bucle(tAnalisis* a, const char* mensaje, const char* cerca) {
+    if (!a->error) {
+        fprintf(stderr, "msh: %s%s%s\n", mensaje, cerca ? ": " : "", cerca ? cerca : "");
+    }
+    a->error = 1;
+}
+
+static void anotar_hueco(tSentencia* s, char** destino, int comando, tVariable* variables) {
+    tHueco h = {.destino = destino, .comando = comando};
+    if (preparar_hueco(&h, *destino, variables) == 0) {
+        liberar_hueco(&h);
+        return;
+    }
+    if ((s->nhuecos & (s->nhuecos - 1)) == 0) {
+        s->huecos = realloc(s->huecos, (s->nhuecos ? s->nhuecos * 2 : 1) * sizeof(tHueco));
+    }
+    s->huecos[s->nhuecos++] = h;
+}
+
+// Una linea normal: se tokeniza aqui y nunca mas
+static tSentencia* leer_linea(tAnalisis* a, char* texto) {
+    tline* linea = tokenize(texto);
+    if (linea == NULL) {
+        a->error = 1; // tokenize ya ha informado
+        return NULL;
+    }
+    if (linea->ncommands == 0) {
+        return NULL;
+    }
+    tSentencia* s = calloc(1, sizeof(tSentencia));
+    s->tipo = B_LINEA;
+    s->linea = copiar_tline(linea);
+    linea = s->linea;
+    for (int i = 0; i < linea->ncommands; i++) {
+        for (int j = 0; j < linea->commands[i].argc; j++) {
+            if (strchr(linea->commands[i].argv[j], '$')) {
+                anotar_hueco(s, &linea->commands[i].argv[j], j == 0 ? i : -1, a->variables);
+            }
+        }
+    }
+    char** redirecciones[] = {&linea->redirect_input, &linea->redirect_output, &linea->redirect_error};
+    for (int i = 0; i < 3; i++) {
+        if (*redirecciones[i] && strchr(*redirecciones[i], '$')) {
+            anotar_hueco(s, redirecciones[i], -1, a->variables);
+        }
+    }
+    s->original = malloc(linea->ncommands * sizeof(tcommand));
+    memcpy(s->original, linea->commands, linea->ncommands * sizeof(tcommand));
+    return s;
+}
+
+static tSentencia* leer_lista(tAnalisis* a, const char* fin);
+
+// Tras la cabecera de un bucle: do lista done
+static tSentencia* leer_cuerpo(tAnalisis* a) {
+    if (a->i >= a->n || strcmp(a->segmentos[a->i], "do") != 0) {
+        error_bucle(a, "se esperaba do", a->i < a->n ? a->segmentos[a->i] : NULL);
+        return NULL;
+    }
+    a->i++;
+    tSentencia* cuerpo = leer_lista(a, "done");
+    if (!a->error && cuerpo == NULL) {
+        error_bucle(a, "bucle sin cuerpo", NULL);
+    }
+    a->i++; // done
+    return cuerpo;
+}
+
+static int leer_rango(const char* palabra, long* desde, long* hasta) {
+    char resto;
+    return sscanf(palabra, "{%ld..%ld%c", desde, hasta, &resto) == 3 && resto == '}'
+        && palabra[strlen(palabra) - 1] == '}';
+}
+
+static tSentencia* leer_for(tAnalisis* a) {
+    char* p = saltar_blancos(a->segmentos[a->i] + 3);
+    a->i++;
+    char* nombre = strsep(&p, " \t");
+    size_t largo = strlen(nombre);
+    int valido = largo > 0;
+    for (size_t i = 0; i < largo; i++) valido = valido && es_nombre(nombre[i], i == 0);
+    if (!valido) {
+        error_bucle(a, "for: nombre de variable no valido", nombre);
+        return NULL;
+    }
+    p = p ? saltar_blancos(p) : NULL;
+    if (p == NULL || !es_palabra(p, "in")) {
+        error_bucle(a, "for: se esperaba 'in'", NULL);
+        return NULL;
+    }
+    p += 2;
+
+    tSentencia* s = calloc(1, sizeof(tSentencia));
+    s->tipo = B_FOR;
+    char* palabra;
+    while ((palabra = strsep(&p, " \t")) != NULL) {
+        if (*palabra == '\0') continue;
+        s->palabras = realloc(s->palabras, (s->npalabras + 1) * sizeof(tPalabra));
+        tPalabra* w = &s->palabras[s->npalabras++];
+        memset(w, 0, sizeof(tPalabra));
+        w->es_rango = leer_rango(palabra, &w->desde, &w->hasta);
+        if (!w->es_rango) {
+            // La lista ve las variables de los bucles de fuera, no la suya
+            preparar_hueco(&w->hueco, palabra, a->variables);
+        }
+    }
+
+    s->variable = calloc(1, sizeof(tVariable));
+    s->variable->nombre = nombre;
+    s->variable->largo_nombre = largo;
+    s->variable->valor = "";
+    s->variable->exterior = a->variables;
+    a->variables = s->variable;
+    s->cuerpo = leer_cuerpo(a);
+    a->variables = s->variable->exterior;
+    return s;
+}
+
+static tSentencia* leer_while(tAnalisis* a) {
+    char* resto = saltar_blancos(a->segmentos[a->i] + 5);
+    if (*resto) {
+        a->segmentos[a->i] = resto; // la primera linea de la condicion
+    } else {
+        a->i++;
+    }
+    tSentencia* s = calloc(1, sizeof(tSentencia));
+    s->tipo = B_WHILE;
+    s->condicion = leer_lista(a, "do");
+    if (!a->error && s->condicion == NULL) {
+        error_bucle(a, "while sin condicion", NULL);
+    }
+    if (!a->error) {
+        s->cuerpo = leer_cuerpo(a);
+    }
+    return s;
+}
+
+// Sentencias hasta el segmento fin (que no se consume) o hasta el final
+static tSentencia* leer_lista(tAnalisis* a, const char* fin) {
+    tSentencia* primera = NULL;
+    tSentencia** ultima = &primera;
+    while (!a->error) {
+        if (a->i >= a->n) {
+            if (fin) error_bucle(a, "falta", fin);
+            break;
+        }
+        char* segmento = a->segmentos[a->i];
+        if (fin && strcmp(segmento, fin) == 0) {
+            break;
+        }
+        tSentencia* s = NULL;
+        if (es_palabra(segmento, "for")) {
+            s = leer_for(a);
+        } else if (es_palabra(segmento, "while")) {
+            s = leer_while(a);
+        } else if (strcmp(segmento, "do") == 0 || strcmp(segmento, "done") == 0) {
+            error_bucle(a, "inesperado", segmento);
+        } else {
+            s = leer_linea(a, segmento);
+            a->i++;
+        }
+        if (s) {
+            *ultima = s;
+            ultima = &s->siguiente;
+        }
+    }
+    return primera;
+}
+
+// Ejecucion
+
+static void comprobar_interrupcion() {
+    if (ultimo_estado == 128 + SIGINT) {
+        interrumpido = 1;
+    } else if (shell_interactiva) {
+        // Con solo internas no muere ningun hijo: el Ctrl-C espera en el
+        // signalfd de la shell, que lo tiene bloqueado
+        sigset_t pendientes;
+        sigpending(&pendientes);
+        if (sigismember(&pendientes, SIGINT)) interrumpido = 1;
+    }
+}
+
+static void ejecutar_sentencias(tSentencia* s);
+
+static void ejecutar_linea_bucle(tSentencia* s) {
+    tline* linea = s->linea;
+    memcpy(linea->commands, s->original, linea->ncommands * sizeof(tcommand));
+    for (int i = 0; i < s->nhuecos; i++) {
+        tHueco* h = &s->huecos[i];
+        *h->destino = expandir(h, NULL);
+        if (h->comando >= 0) {
+            // Solo para el mensaje de error de un comando que no existe. La
+            // ruta de hash_buscar puede no durar mas alla de esta linea y
+            // ejecutar_linea empieza otra: basta con el nombre
+            linea->commands[h->comando].filename = hash_buscar(*h->destino) ? *h->destino : NULL;
+        }
+    }
+    procesar_hijos_terminados();
+    fflush(stdout);
+    ejecutar_linea(linea);
+    comprobar_interrupcion();
+}
+
+// Una vuelta: devuelve 0 si hay que dejar de dar vueltas
+static int vuelta(tSentencia* cuerpo, int* estado) {
+    ejecutar_sentencias(cuerpo);
+    *estado = ultimo_estado;
+    return !interrumpido;
+}
+
+// Escribe n en decimal en el buffer de la variable
+static void valor_numero(tVariable* v, long n) {
+    char* fin = v->numero + sizeof(v->numero);
+    char* p = fin;
+    unsigned long u = n < 0 ? -(unsigned long)n : (unsigned long)n;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (n < 0) *--p = '-';
+    v->valor = p;
+    v->largo = fin - p;
+}
+
+static void ejecutar_for(tSentencia* s) {
+    tVariable* v = s->variable;
+    int estado = 0;
+    for (int i = 0; i < s->npalabras; i++) {
+        tPalabra* w = &s->palabras[i];
+        if (w->es_rango) {
+            long paso = w->desde <= w->hasta ? 1 : -1;
+            for (long n = w->desde;; n += paso) {
+                valor_numero(v, n);
+                if (!vuelta(s->cuerpo, &estado) || n == w->hasta) break;
+            }
+        } else {
+            v->valor = expandir(&w->hueco, &v->largo);
+            vuelta(s->cuerpo, &estado);
+        }
+        if (interrumpido) return;
+    }
+    ultimo_estado = estado;
+}
+
+static void ejecutar_while(tSentencia* s) {
+    int estado = 0;
+    while (1) {
+        ejecutar_sentencias(s->condicion);
+        if (interrumpido) return;
+        if (ultimo_estado != 0 || !vuelta(s->cuerpo, &estado)) break;
+    }
+    if (!interrumpido) ultimo_estado = estado;
+}
+
+static void ejecutar_sentencias(tSentencia* s) {
+    for (; s && !interrumpido; s = s->siguiente) {
+        if (s->tipo == B_LINEA) ejecutar_linea_bucle(s);
+        else if (s->tipo == B_FOR) ejecutar_for(s);
+        else ejecutar_while(s);
+    }
+}
+
+// Lee el texto completo de uno o varios bucles y lo ejecuta
+static void ejecutar_bucles(char* texto) {
+    tAnalisis a = {0};
+    a.segmentos = trocear_segmentos(texto, &a.n);
+    tSentencia* sentencias = leer_lista(&a, NULL);
+    if (a.error) {
+        ultimo_estado = 2;
+    } else {
+        interrumpido = 0;
+        ejecutar_sentencias(sentencias);
+    }
+    liberar_sentencias(sentencias);
+    free(a.segmentos);
+}
+
+// Interfaz con la lectura de lineas
+
+int bucle_linea(const char* str) {
+    const char* p = str;
+    while (*p == ' ' || *p == '\t') p++;
+    if (pendiente == NULL && !es_palabra(p, "for") && !es_palabra(p, "while")) {
+        return 0;
+    }
+    size_t largo = strcspn(str, "\n");
+    size_t antes = pendiente ? strlen(pendiente) : 0;
+    pendiente = realloc(pendiente, antes + largo + 2);
+    if (antes) pendiente[antes++] = ';';
+    memcpy(pendiente + antes, str, largo);
+    pendiente[antes + largo] = '\0';
+    if (profundidad(pendiente) > 0) {
+        return 1; // faltan lineas hasta el done
+    }
+    char* texto = pendiente;
+    pendiente = NULL;
+    ejecutar_bucles(texto);
+    free(texto);
+    return 1;
+}
+
+int bucle_pendiente() {
+    return pendiente != NULL;
+}
+
+void bucle_abandonar(int avisar) {
+    if (pendiente) {
+        if (avisar) fprintf(stderr, "msh: falta done\n");
+        free(pendiente);
+        pendiente = NULL;
+        ultimo_estado = 2;
+    }
+}
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// msh_cliente [-o] [-q] socket [linea...]
+//
+// Cliente de miniShell --serve: manda cada linea (los argumentos o, si no
+// hay, la entrada estandar linea a linea) sin esperar a que terminen las
+// anteriores, y va mostrando los resultados segun llegan. Con -o se pide y se
+// escribe la salida de cada comando; con -q no se muestra el resumen de cada
+// uno. Termina con el estado del comando si solo habia uno; si no, con 0 si
+// todos terminaron con 0 y 1 si alguno fallo.
+
+#define MAX_EN_VUELO 4096
+
+typedef struct {
+    char* datos;
+    size_t n, capacidad, hecho;
+} tBuffer;
+
+// Quita del principio lo ya consumido
+static void compactar(tBuffer* b) {
+    if (b->hecho == 0) return;
+    b->n -= b->hecho;
+    memmove(b->datos, b->datos + b->hecho, b->n);
+    b->hecho = 0;
+}
+
+static void anadir(tBuffer* b, const char* datos, size_t n) {
+    if (b->n + n > b->capacidad) compactar(b);
+    if (b->n + n > b->capacidad) {
+        while (b->n + n > b->capacidad) b->capacidad = b->capacidad ? b->capacidad * 2 : 65536;
+        b->datos = realloc(b->datos, b->capacidad);
+    }
+    memcpy(b->datos + b->n, datos, n);
+    b->n += n;
+}
+
+static double ahora() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int capturar = 0, silencioso = 0;
+static long enviadas = 0, recibidas = 0, fallidas = 0;
+static int ultimo_estado = 0;
+
+static void peticion(tBuffer* salida, const char* linea) {
+    char cabecera[64];
+    int n = snprintf(cabecera, sizeof(cabecera), "%ld\t%s\t", enviadas + 1, capturar ? "o" : "-");
+    anadir(salida, cabecera, n);
+    anadir(salida, linea, strcspn(linea, "\n"));
+    anadir(salida, "\n", 1);
+    enviadas++;
+}
+
+// Consume las respuestas completas del buffer
+static void respuestas(tBuffer* entrada) {
+    while (1) {
+        char* inicio = entrada->datos + entrada->hecho;
+        size_t quedan = entrada->n - entrada->hecho;
+        char* salto = memchr(inicio, '\n', quedan);
+        if (salto == NULL) {
+            break;
+        }
+        char id[64];
+        int estado;
+        long real, usuario, sistema, maxrss;
+        long long bytes;
+        *salto = '\0';
+        if (sscanf(inicio, "%63[^\t]\t%d\t%ld\t%ld\t%ld\t%ld\t%lld",
+                   id, &estado, &real, &usuario, &sistema, &maxrss, &bytes) != 7) {
+            fprintf(stderr, "msh_cliente: respuesta no valida: %s\n", inicio);
+            exit(2);
+        }
+        size_t cabecera = salto + 1 - inicio;
+        if (quedan < cabecera + bytes) {
+            *salto = '\n'; // Falta la salida: se espera a que llegue entera
+            break;
+        }
+        if (bytes > 0) {
+            fwrite(salto + 1, 1, bytes, stdout);
+            fflush(stdout); // Antes que el resumen, que va por stderr
+        }
+        if (!silencioso) {
+            fprintf(stderr, "[%s] estado %d  real %.3f ms  user %.3f ms  sys %.3f ms  maxrss %ld KiB\n",
+                    id, estado, real / 1e3, usuario / 1e3, sistema / 1e3, maxrss);
+        }
+        entrada->hecho += cabecera + bytes;
+        recibidas++;
+        ultimo_estado = estado;
+        if (estado != 0) fallidas++;
+    }
+    // Lo que queda (una respuesta a medias) pasa al principio del buffer
+    compactar(entrada);
+}
+
+int main(int argc, char* argv[]) {
+    int opcion;
+    while ((opcion = getopt(argc, argv, "oq")) != -1) {
+        if (opcion == 'o') capturar = 1;
+        else if (opcion == 'q') silencioso = 1;
+        else {
+            fprintf(stderr, "Uso: %s [-o] [-q] socket [linea...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Uso: %s [-o] [-q] socket [linea...]\n", argv[0]);
+        return 2;
+    }
+    const char* ruta = argv[optind++];
+
+    struct sockaddr_un dir = {.sun_family = AF_UNIX};
+    strncpy(dir.sun_path, ruta, sizeof(dir.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&dir, sizeof(dir)) < 0) {
+        fprintf(stderr, "%s: Error. %s\n", ruta, strerror(errno));
+        return 2;
+    }
+
+    tBuffer salida = {0}, entrada = {0};
+    int argumentos = optind < argc;
+    int fin_lineas = 0, cerrado = 0;
+    char* linea = NULL;
+    size_t capacidad = 0;
+    double inicio = ahora();
+
+    while (!cerrado || recibidas < enviadas) {
+        // Mas lineas mientras no haya demasiadas en vuelo
+        while (!fin_lineas && enviadas - recibidas < MAX_EN_VUELO && salida.n - salida.hecho < 65536) {
+            if (argumentos) {
+                peticion(&salida, argv[optind++]);
+                fin_lineas = optind >= argc;
+            } else if (getline(&linea, &capacidad, stdin) >= 0) {
+                peticion(&salida, linea);
+            } else {
+                fin_lineas = 1;
+            }
+        }
+        if (fin_lineas && !cerrado && salida.hecho == salida.n) {
+            shutdown(fd, SHUT_WR); // El servidor sabe que no hay mas lineas
+            cerrado = 1;
+            continue;
+        }
+
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (salida.hecho < salida.n) pfd.events |= POLLOUT;
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 2;
+        }
+        if (pfd.revents & POLLOUT) {
+            ssize_t n = send(fd, salida.datos + salida.hecho, salida.n - salida.hecho,
+                             MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n > 0) salida.hecho += n;
+            if (salida.hecho == salida.n) salida.n = salida.hecho = 0;
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            char buf[65536];
+            ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                fprintf(stderr, "msh_cliente: el servidor ha cerrado la conexion\n");
+                return 2;
+            }
+            if (n > 0) {
+                anadir(&entrada, buf, n);
+                respuestas(&entrada);
+            }
+        }
+    }
+
+    double segundos = ahora() - inicio;
+    if (!silencioso && enviadas > 1) {
+        fprintf(stderr, "msh_cliente: %ld lineas en %.3f s (%.0f/s), %ld con error\n",
+                enviadas, segundos, enviadas / segundos, fallidas);
+    }
+    if (enviadas == 1) {
+        return ultimo_estado;
+    }
+    return fallidas ? 1 : 0;
+}
@@ -0,0 +1,511 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "myshell.h"
+
+// Colocacion de los procesos lanzados: CPUs, politica, nice y prioridad de E/S.
+//
+// El ajuste de la shell (interna sched) vale para todo lo que se lance y los
+// prefijos MSH_CPUS=, MSH_NICE=, MSH_SCHED= y MSH_IOPRIO= lo cambian solo para
+// una linea, como MSH_PIPE_SZ=. En cpus una lista por etapa separada por ':'
+// fija cada etapa de la pipeline (la ultima lista vale para las que sobran) y
+// auto reparte las etapas por la topologia de /sys: etapas contiguas en
+// nucleos contiguos que comparten L2 o L3, un nucleo fisico por etapa antes de
+// usar los hilos hermanos, y cada linea empieza donde acabo la anterior para
+// que dos jobs no caigan en los mismos nucleos. Un comando solo se fija al
+// dominio de L3 que le toca entero.
+//
+// La shell resuelve los ajustes de cada etapa (colocacion_etapa) y el hijo
+// los aplica antes del exec, asi que lo que el comando cree ya los hereda: con
+// fork y el zygote en preparar_hijo. posix_spawn no sabe aplicarlos: con ese
+// backend las etapas con algun ajuste se lanzan con fork. La colocacion de la
+// propia shell no se toca nunca.
+// Sin ningun ajuste no se hace ni una llamada al sistema mas.
+
+#ifndef RUTA_CPUS
+#define RUTA_CPUS "/sys/devices/system/cpu"
+#endif
+
+#define IOPRIO_CLASE_RT 1
+#define IOPRIO_CLASE_BE 2
+#define IOPRIO_CLASE_IDLE 3
+#define IOPRIO_DESPLAZAMIENTO 13
+#define IOPRIO_QUIEN_PROCESO 1
+
+_Static_assert(sizeof(cpu_set_t) == sizeof(((tColocacionEtapa*)0)->cpus), "cpus es un cpu_set_t");
+
+tColocacion colocacion = {.politica = -1, .ioprio = -1};
+
+// CPU permitida con las claves de su sitio en la topologia
+typedef struct {
+    int cpu;
+    int l3;             // menor CPU que comparte la L3 (o el paquete si no hay L3)
+    int l2;             // menor CPU que comparte la L2 (o el nucleo)
+    int nucleo;         // menor CPU del nucleo fisico
+    int hilo;           // 0 para el primer hilo de cada nucleo
+} tCpu;
+
+static tCpu* topologia = NULL;      // en el orden de reparto
+static int ncpus = 0;
+static int siguiente_cpu = 0;       // donde empieza el reparto de la siguiente linea
+
+static int activa = 0;              // la linea que se lanza tiene algun ajuste
+static int avisado = 0;             // ya se ha informado de un error en esta linea
+static cpu_set_t* reparto = NULL;   // cpus=auto: conjunto de cada etapa
+static int capacidad_reparto = 0;
+static char aplicada[256];          // descripcion para jobs
+static tColocacionEtapa etapa_actual; // lo que devuelve colocacion_etapa
+
+// Listas de CPUs como las de /sys: "0-3,8,10-11"
+
+static int parsear_lista(const char* texto, size_t largo, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = texto;
+    const char* fin = texto + largo;
+    while (p < fin) {
+        char* q;
+        long desde = strtol(p, &q, 10);
+        long hasta = desde;
+        if (q == p || desde < 0) return -1;
+        if (q < fin && *q == '-') {
+            p = q + 1;
+            hasta = strtol(p, &q, 10);
+            if (q == p || hasta < desde) return -1;
+        }
+        if (hasta >= CPU_SETSIZE) return -1;
+        for (long c = desde; c <= hasta; c++) CPU_SET(c, set);
+        if (q < fin && *q != ',') return -1;
+        p = q + 1;
+    }
+    return CPU_COUNT(set) ? 0 : -1;
+}
+
+static void describir_lista(const cpu_set_t* set, char* buf, size_t largo) {
+    size_t usado = 0;
+    buf[0] = '\0';
+    for (int c = 0; c < CPU_SETSIZE && usado < largo; c++) {
+        if (!CPU_ISSET(c, set)) continue;
+        int ultima = c;
+        while (ultima + 1 < CPU_SETSIZE && CPU_ISSET(ultima + 1, set)) ultima++;
+        int n = ultima > c ? snprintf(buf + usado, largo - usado, "%s%d-%d", usado ? "," : "", c, ultima)
+                           : snprintf(buf + usado, largo - usado, "%s%d", usado ? "," : "", c);
+        usado += n;
+        c = ultima;
+    }
+}
+
+static int menor_cpu(const cpu_set_t* set) {
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, set)) return c;
+    }
+    return -1;
+}
+
+// Topologia
+
+static int leer_fichero(const char* ruta, char* buf, size_t largo) {
+    FILE* f = fopen(ruta, "re");
+    if (f == NULL) {
+        return -1;
+    }
+    int ok = fgets(buf, largo, f) != NULL;
+    fclose(f);
+    if (!ok) return -1;
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int leer_lista_sys(const char* ruta, cpu_set_t* set) {
+    char buf[4096];
+    if (leer_fichero(ruta, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    return parsear_lista(buf, strlen(buf), set);
+}
+
+static int comparar_cpus(const void* a, const void* b) {
+    const tCpu* x = a;
+    const tCpu* y = b;
+    if (x->l3 != y->l3) return x->l3 - y->l3;
+    if (x->hilo != y->hilo) return x->hilo - y->hilo;
+    if (x->l2 != y->l2) return x->l2 - y->l2;
+    if (x->nucleo != y->nucleo) return x->nucleo - y->nucleo;
+    return x->cpu - y->cpu;
+}
+
+static void leer_topologia() {
+    cpu_set_t permitidas;
+    if (sched_getaffinity(0, sizeof(permitidas), &permitidas) != 0) {
+        CPU_ZERO(&permitidas);
+        CPU_SET(0, &permitidas);
+    }
+    topologia = malloc(CPU_COUNT(&permitidas) * sizeof(tCpu));
+    char ruta[256], buf[64];
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &permitidas)) continue;
+        tCpu c = {.cpu = cpu, .l3 = -1, .l2 = -1, .nucleo = cpu};
+
+        cpu_set_t hermanas;
+        snprintf(ruta, sizeof(ruta), RUTA_CPUS "/cpu%d/topology/thread_siblings_list", cpu);
+        if (leer_lista_sys(ruta, &hermanas) == 0) {
+            c.nucleo = menor_cpu(&hermanas);
+            for (int h = 0; h < cpu; h++) c.hilo += CPU_ISSET(h, &hermanas) != 0;
+        }
+        for (int i = 0; i < 16; i++) {
+            snprintf(ruta, sizeof(ruta), RUTA_CPUS "/cpu%d/cache/index%d/level", cpu, i);
+            if (leer_fichero(ruta, buf, sizeof(buf)) != 0) break;
+            int nivel = atoi(buf);
+            cpu_set_t compartida;
+            snprintf(ruta, sizeof(ruta), RUTA_CPUS "/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+            if ((nivel == 2 || nivel == 3) && leer_lista_sys(ruta, &compartida) == 0) {
+                if (nivel == 2) c.l2 = menor_cpu(&compartida);
+                else c.l3 = menor_cpu(&compartida);
+            }
+        }
+        if (c.l2 < 0) c.l2 = c.nucleo;
+        if (c.l3 < 0) {
+            // Sin L3 el dominio es el paquete; no se confunde con un numero de CPU
+            snprintf(ruta, sizeof(ruta), RUTA_CPUS "/cpu%d/topology/physical_package_id", cpu);
+            c.l3 = CPU_SETSIZE + (leer_fichero(ruta, buf, sizeof(buf)) == 0 ? atoi(buf) : 0);
+        }
+        topologia[ncpus++] = c;
+    }
+    qsort(topologia, ncpus, sizeof(tCpu), comparar_cpus);
+}
+
+// Etapas de la linea en CPUs consecutivas del orden de la topologia
+static void repartir(int etapas) {
+    if (topologia == NULL) {
+        leer_topologia();
+    }
+    if (etapas > capacidad_reparto) {
+        capacidad_reparto = etapas;
+        reparto = realloc(reparto, capacidad_reparto * sizeof(cpu_set_t));
+    }
+    int inicio = siguiente_cpu % ncpus;
+    int dominio = inicio, fin = inicio;
+    while (dominio > 0 && topologia[dominio - 1].l3 == topologia[inicio].l3) dominio--;
+    while (fin < ncpus && topologia[fin].l3 == topologia[inicio].l3) fin++;
+
+    if (etapas == 1) {
+        CPU_ZERO(&reparto[0]);
+        for (int i = dominio; i < fin; i++) CPU_SET(topologia[i].cpu, &reparto[0]);
+        siguiente_cpu = fin;
+        return;
+    }
+    // Si la pipeline cabe en los nucleos fisicos de un dominio pero no en lo
+    // que queda de ellos, o en el dominio entero pero no en lo que queda de
+    // el, empieza en el siguiente dominio
+    int nucleos = 0;
+    for (int i = dominio; i < fin; i++) nucleos += topologia[i].hilo == 0;
+    if (etapas <= nucleos ? inicio + etapas > dominio + nucleos
+                          : fin - inicio < etapas && etapas <= fin - dominio) {
+        inicio = fin % ncpus;
+    }
+    for (int i = 0; i < etapas; i++) {
+        CPU_ZERO(&reparto[i]);
+        CPU_SET(topologia[(inicio + i) % ncpus].cpu, &reparto[i]);
+    }
+    siguiente_cpu = inicio + etapas;
+}
+
+// Ajustes: cpus=, nice=, policy= y ioprio=
+
+static const char* nombre_politica(int politica) {
+    return politica == SCHED_BATCH ? "batch" : politica == SCHED_IDLE ? "idle" : "other";
+}
+
+int parsear_colocacion(const char* clave, const char* valor, tColocacion* c) {
+    char* fin;
+    if (strcmp(clave, "cpus") == 0) {
+        if (strcmp(valor, "all") == 0 || *valor == '\0') {
+            c->cpus[0] = '\0';
+            return 0;
+        }
+        if (strcmp(valor, "auto") != 0) {
+            // Se comprueba ahora cada lista; al lanzar se vuelve a leer la de la etapa
+            for (const char* p = valor; ; ) {
+                size_t largo = strcspn(p, ":");
+                cpu_set_t set;
+                if (parsear_lista(p, largo, &set) != 0) return -1;
+                if (p[largo] == '\0') break;
+                p += largo + 1;
+            }
+        }
+        if (strlen(valor) >= sizeof(c->cpus)) return -1;
+        strcpy(c->cpus, valor);
+    } else if (strcmp(clave, "nice") == 0) {
+        if (strcmp(valor, "none") == 0) {
+            c->con_nice = 0;
+            return 0;
+        }
+        long n = strtol(valor, &fin, 10);
+        if (fin == valor || *fin != '\0' || n < -20 || n > 19) return -1;
+        c->con_nice = 1;
+        c->nice = (int)n;
+    } else if (strcmp(clave, "policy") == 0) {
+        if (strcmp(valor, "batch") == 0) c->politica = SCHED_BATCH;
+        else if (strcmp(valor, "idle") == 0) c->politica = SCHED_IDLE;
+        else if (strcmp(valor, "other") == 0) c->politica = SCHED_OTHER;
+        else if (strcmp(valor, "none") == 0) c->politica = -1;
+        else return -1;
+    } else if (strcmp(clave, "ioprio") == 0) {
+        int clase;
+        long nivel = 4;
+        size_t largo = strcspn(valor, ":");
+        if (strcmp(valor, "none") == 0) {
+            c->ioprio = -1;
+            return 0;
+        }
+        if (strncmp(valor, "idle", largo) == 0 && largo == 4) clase = IOPRIO_CLASE_IDLE;
+        else if (strncmp(valor, "be", largo) == 0 && largo == 2) clase = IOPRIO_CLASE_BE;
+        else if (strncmp(valor, "rt", largo) == 0 && largo == 2) clase = IOPRIO_CLASE_RT;
+        else return -1;
+        if (valor[largo] == ':') {
+            nivel = strtol(valor + largo + 1, &fin, 10);
+            if (clase == IOPRIO_CLASE_IDLE || fin == valor + largo + 1 || *fin != '\0'
+                || nivel < 0 || nivel > 7) return -1;
+        }
+        c->ioprio = (clase << IOPRIO_DESPLAZAMIENTO) | (clase == IOPRIO_CLASE_IDLE ? 0 : (int)nivel);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void describir_colocacion(const tColocacion* c, char* buf, size_t largo) {
+    size_t usado = 0;
+    buf[0] = '\0';
+#define ANADIR(...) if (usado < largo) usado += snprintf(buf + usado, largo - usado, __VA_ARGS__)
+    if (c->cpus[0]) ANADIR("cpus=%s", c->cpus);
+    if (c->con_nice) ANADIR("%snice=%d", usado ? " " : "", c->nice);
+    if (c->politica >= 0) ANADIR("%spolicy=%s", usado ? " " : "", nombre_politica(c->politica));
+    if (c->ioprio >= 0) {
+        int clase = c->ioprio >> IOPRIO_DESPLAZAMIENTO;
+        if (clase == IOPRIO_CLASE_IDLE) {
+            ANADIR("%sioprio=idle", usado ? " " : "");
+        } else {
+            ANADIR("%sioprio=%s:%d", usado ? " " : "", clase == IOPRIO_CLASE_RT ? "rt" : "be",
+                   c->ioprio & ((1 << IOPRIO_DESPLAZAMIENTO) - 1));
+        }
+    }
+#undef ANADIR
+}
+
+// Aplicacion
+
+static void avisar(const char* que) {
+    if (!avisado) {
+        fprintf(stderr, "msh: %s: %s\n", que, strerror(errno));
+    }
+    avisado = 1;
+}
+
+// Conjunto de la etapa en una lista explicita: la suya o la ultima
+static void lista_etapa(const tColocacion* c, int etapa, cpu_set_t* set) {
+    const char* p = c->cpus;
+    for (int i = 0; i < etapa && strchr(p, ':'); i++) {
+        p = strchr(p, ':') + 1;
+    }
+    parsear_lista(p, strcspn(p, ":"), set);
+}
+
+// Los ajustes de c para una etapa, con su conjunto de CPUs ya decidido
+static void resolver(const tColocacion* c, const cpu_set_t* cpus, tColocacionEtapa* e) {
+    *e = (tColocacionEtapa){
+        .politica = c->politica, .con_nice = c->con_nice, .nice = c->nice, .ioprio = c->ioprio,
+    };
+    if (cpus) {
+        e->con_cpus = 1;
+        memcpy(e->cpus, cpus, sizeof(cpu_set_t));
+    }
+}
+
+static void aplicar(pid_t pid, const tColocacionEtapa* e) {
+    if (e->con_cpus) {
+        cpu_set_t set;
+        memcpy(&set, e->cpus, sizeof(set));
+        if (sched_setaffinity(pid, sizeof(set), &set) != 0) avisar("cpus");
+    }
+    if (e->politica >= 0) {
+        struct sched_param parametros = {0};
+        if (sched_setscheduler(pid, e->politica, &parametros) != 0) avisar("policy");
+    }
+    if (e->con_nice && setpriority(PRIO_PROCESS, pid, e->nice) != 0) {
+        avisar("nice");
+    }
+    if (e->ioprio >= 0 && syscall(SYS_ioprio_set, IOPRIO_QUIEN_PROCESO, pid, e->ioprio) != 0) {
+        avisar("ioprio");
+    }
+}
+
+void colocar_linea(int etapas) {
+    activa = colocacion.cpus[0] || colocacion.con_nice || colocacion.politica >= 0
+          || colocacion.ioprio >= 0;
+    avisado = 0;
+    if (!activa) {
+        return;
+    }
+    describir_colocacion(&colocacion, aplicada, sizeof(aplicada));
+    if (strcmp(colocacion.cpus, "auto") != 0 || etapas < 1) {
+        return;
+    }
+    // En jobs se ve donde ha caido cada etapa: cpus=auto:0|2|4
+    repartir(etapas);
+    char lista[128];
+    size_t usado = snprintf(aplicada, sizeof(aplicada), "cpus=auto:");
+    for (int i = 0; i < etapas && usado < sizeof(aplicada); i++) {
+        describir_lista(&reparto[i], lista, sizeof(lista));
+        usado += snprintf(aplicada + usado, sizeof(aplicada) - usado, "%s%s", i ? "|" : "", lista);
+    }
+    char resto[128];
+    tColocacion sin_cpus = colocacion;
+    sin_cpus.cpus[0] = '\0';
+    describir_colocacion(&sin_cpus, resto, sizeof(resto));
+    if (resto[0] && usado < sizeof(aplicada)) {
+        snprintf(aplicada + usado, sizeof(aplicada) - usado, " %s", resto);
+    }
+}
+
+const tColocacionEtapa* colocacion_etapa(int etapa) {
+    if (!activa) {
+        return NULL;
+    }
+    cpu_set_t set;
+    const cpu_set_t* cpus = NULL;
+    if (strcmp(colocacion.cpus, "auto") == 0) {
+        cpus = &reparto[etapa];
+    } else if (colocacion.cpus[0]) {
+        lista_etapa(&colocacion, etapa, &set);
+        cpus = &set;
+    }
+    resolver(&colocacion, cpus, &etapa_actual);
+    return &etapa_actual;
+}
+
+void aplicar_colocacion(const tColocacionEtapa* e) {
+    aplicar(0, e);
+}
+
+const char* colocacion_aplicada() {
+    return activa ? aplicada : NULL;
+}
+
+// Descripcion de un job tras cambiarle algunos ajustes: los de antes cuya
+// clave no se ha tocado y despues los nuevos
+static void fusionar(const char* antes, const char* cambios, char* buf, size_t largo) {
+    size_t usado = 0;
+    buf[0] = '\0';
+    const char* p = antes ? antes : "";
+    while (*p) {
+        size_t n = strcspn(p, " ");
+        size_t clave = strcspn(p, "=");
+        char patron[32];
+        snprintf(patron, sizeof(patron), "%.*s=", (int)(clave < 30 ? clave : 30), p);
+        int tocada = strncmp(cambios, patron, strlen(patron)) == 0;
+        for (const char* q = strchr(cambios, ' '); q && !tocada; q = strchr(q + 1, ' ')) {
+            tocada = strncmp(q + 1, patron, strlen(patron)) == 0;
+        }
+        if (!tocada && usado < largo) {
+            usado += snprintf(buf + usado, largo - usado, "%s%.*s", usado ? " " : "", (int)n, p);
+        }
+        p += n;
+        while (*p == ' ') p++;
+    }
+    if (usado < largo) snprintf(buf + usado, largo - usado, "%s%s", usado ? " " : "", cambios);
+}
+
+// sched [clave=valor... | reset]: ajuste de la shell
+// sched %N clave=valor...: cambia un job que ya esta en marcha
+//
+// claves: cpus=LISTA[:LISTA...]|auto|all  nice=N|none  policy=batch|idle|other|none
+//         ioprio=idle|be[:N]|rt[:N]|none
+
+static int parsear_argumentos(tcommand* cmd, int desde, tColocacion* c) {
+    for (int i = desde; i < cmd->argc; i++) {
+        char* igual = strchr(cmd->argv[i], '=');
+        char clave[16];
+        if (igual == NULL || igual - cmd->argv[i] >= (long)sizeof(clave)) {
+            fprintf(stderr, "sched: se esperaba clave=valor: %s\n", cmd->argv[i]);
+            return -1;
+        }
+        snprintf(clave, sizeof(clave), "%.*s", (int)(igual - cmd->argv[i]), cmd->argv[i]);
+        if (parsear_colocacion(clave, igual + 1, c) != 0) {
+            fprintf(stderr, "sched: ajuste no valido: %s\n", cmd->argv[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int cambiar_job(tcommand* cmd) {
+    tJob* job = getJobxId(atoi(cmd->argv[1] + 1));
+    if (job == NULL) {
+        fprintf(stderr, "sched: %s: no existe ese job\n", cmd->argv[1]);
+        return 1;
+    }
+    tColocacion c = {.politica = -1, .ioprio = -1};
+    if (cmd->argc < 3 || parsear_argumentos(cmd, 2, &c) != 0) {
+        if (cmd->argc < 3) fprintf(stderr, "sched: uso: sched %%N clave=valor...\n");
+        return 2;
+    }
+    if (strchr(c.cpus, ':') || strcmp(c.cpus, "auto") == 0) {
+        fprintf(stderr, "sched: a un job en marcha solo se le da una lista de cpus\n");
+        return 2;
+    }
+    cpu_set_t set;
+    if (c.cpus[0]) lista_etapa(&c, 0, &set);
+    tColocacionEtapa e;
+    resolver(&c, c.cpus[0] ? &set : NULL, &e);
+
+    pid_t pids[1024];
+    int n = job_pids(job, pids, sizeof(pids) / sizeof(pids[0]));
+    avisado = 0;
+    for (int i = 0; i < n; i++) {
+        aplicar(pids[i], &e);
+    }
+    char cambios[256], descripcion[256];
+    describir_colocacion(&c, cambios, sizeof(cambios));
+    fusionar(job->colocacion, cambios, descripcion, sizeof(descripcion));
+    job_colocacion(job, descripcion);
+    return avisado;
+}
+
+int manejador_sched(tline* linea) {
+    tcommand cmd = linea->commands[0];
+    char descripcion[256];
+
+    if (cmd.argc > 1 && cmd.argv[1][0] == '%') {
+        return cambiar_job(&cmd);
+    }
+    if (cmd.argc == 2 && strcmp(cmd.argv[1], "reset") == 0) {
+        colocacion = (tColocacion){.politica = -1, .ioprio = -1};
+        return 0;
+    }
+    if (cmd.argc > 1) {
+        tColocacion nueva = colocacion;
+        if (parsear_argumentos(&cmd, 1, &nueva) != 0) {
+            return 2;
+        }
+        colocacion = nueva;
+        return 0;
+    }
+    describir_colocacion(&colocacion, descripcion, sizeof(descripcion));
+    printf("%s\n", descripcion[0] ? descripcion : "sin ajustes (cpus=all nice=none policy=none ioprio=none)");
+    if (strcmp(colocacion.cpus, "auto") == 0) {
+        if (topologia == NULL) leer_topologia();
+        // El orden en que auto reparte las etapas, con el dominio de L3 de cada CPU
+        printf("orden:");
+        for (int i = 0; i < ncpus; i++) {
+            printf("%s%d", i && topologia[i].l3 != topologia[i - 1].l3 ? " | " : " ", topologia[i].cpu);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <readline/readline.h>
+#include "parser.h"
+#include "myshell.h"
+
+// Completado de nombres de comando con Tab.
+//
+// Un indice ordenado con los ejecutables de todos los directorios de PATH y
+// las internas responde a cada Tab con dos busquedas binarias. Cada
+// directorio se lee una sola vez, desde el bucle de eventos mientras la
+// shell esta ociosa, y despues solo cuando inotify avisa de que ha cambiado
+// (en NFS inotify no ve los cambios de otras maquinas: hash -r lo vuelve a
+// leer todo). Fuera de la primera palabra de cada comando, o con una '/',
+// se deja el completado de ficheros de readline.
+
+#define ESPERA_OCIOSA_MS 20
+#define CAMBIOS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+                 | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct {
+    char* ruta;
+    int wd;                 // vigilancia de inotify, -1 si no hay
+    int sucio;              // hay que volver a leerlo
+    char** nombres;
+    int n;
+} tDirComandos;
+
+static tDirComandos* dirs = NULL;
+static int ndirs = 0;
+static char* path_cargado = NULL;
+static int inotify_fd = -1;
+static int lectura_pendiente = 0;   // hay un timer de lectura ociosa
+
+static char** indice = NULL;        // ordenado y sin repetidos
+static int nindice = 0;
+static int indice_sucio = 1;
+
+static void soltar_dir(tDirComandos* d) {
+    for (int i = 0; i < d->n; i++) free(d->nombres[i]);
+    free(d->nombres);
+    d->nombres = NULL;
+    d->n = 0;
+}
+
+// Trocea PATH; los directorios relativos dependen del cwd y no se indexan
+static void cargar_path() {
+    const char* path = getenv("PATH");
+    if (path == NULL) path = "/bin:/usr/bin";
+    if (path_cargado && strcmp(path, path_cargado) == 0) {
+        return;
+    }
+    for (int i = 0; i < ndirs; i++) {
+        if (dirs[i].wd >= 0) inotify_rm_watch(inotify_fd, dirs[i].wd);
+        soltar_dir(&dirs[i]);
+        free(dirs[i].ruta);
+    }
+    free(dirs);
+    free(path_cargado);
+    path_cargado = strdup(path);
+    dirs = NULL;
+    ndirs = 0;
+
+    char* copia = strdup(path);
+    char* resto = copia;
+    char* dir;
+    while ((dir = strsep(&resto, ":")) != NULL) {
+        if (dir[0] != '/') continue;
+        dirs = realloc(dirs, (ndirs + 1) * sizeof(tDirComandos));
+        tDirComandos* d = &dirs[ndirs++];
+        *d = (tDirComandos){.ruta = strdup(dir), .wd = -1, .sucio = 1};
+        if (inotify_fd >= 0) {
+            d->wd = inotify_add_watch(inotify_fd, dir, CAMBIOS);
+        }
+    }
+    free(copia);
+    indice_sucio = 1;
+}
+
+static int es_ejecutable(int dirfd, const struct dirent* e) {
+    if (e->d_name[0] == '.' || e->d_type == DT_DIR) {
+        return 0;
+    }
+    if (e->d_type != DT_REG) {
+        // Enlaces y sistemas sin d_type: hay que ver a que apuntan
+        struct stat st;
+        if (fstatat(dirfd, e->d_name, &st, 0) < 0 || !S_ISREG(st.st_mode)) {
+            return 0;
+        }
+    }
+    return faccessat(dirfd, e->d_name, X_OK, AT_EACCESS) == 0;
+}
+
+static void leer_dir(tDirComandos* d) {
+    soltar_dir(d);
+    d->sucio = 0;
+    indice_sucio = 1;
+    DIR* dir = opendir(d->ruta);
+    if (dir == NULL) {
+        return;
+    }
+    int capacidad = 0;
+    struct dirent* e;
+    while ((e = readdir(dir)) != NULL) {
+        if (!es_ejecutable(dirfd(dir), e)) continue;
+        if (d->n >= capacidad) {
+            capacidad = capacidad ? capacidad * 2 : 64;
+            d->nombres = realloc(d->nombres, capacidad * sizeof(char*));
+        }
+        d->nombres[d->n++] = strdup(e->d_name);
+    }
+    closedir(dir);
+}
+
+static int comparar_nombres(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void reconstruir_indice() {
+    int total = 0;
+    for (int i = 0; i < ndirs; i++) total += dirs[i].n;
+    for (int i = 0; nombre_interna(i); i++) total++;
+
+    // Los nombres apuntan a los de cada directorio: no se copian
+    indice = realloc(indice, (total > 0 ? total : 1) * sizeof(char*));
+    nindice = 0;
+    for (int i = 0; i < ndirs; i++) {
+        memcpy(indice + nindice, dirs[i].nombres, dirs[i].n * sizeof(char*));
+        nindice += dirs[i].n;
+    }
+    for (int i = 0; nombre_interna(i); i++) {
+        indice[nindice++] = (char*)nombre_interna(i);
+    }
+    qsort(indice, nindice, sizeof(char*), comparar_nombres);
+    int unicos = 0;
+    for (int i = 0; i < nindice; i++) {
+        if (unicos == 0 || strcmp(indice[unicos - 1], indice[i]) != 0) {
+            indice[unicos++] = indice[i];
+        }
+    }
+    nindice = unicos;
+    indice_sucio = 0;
+}
+
+// Deja el indice al dia: lee los directorios pendientes y lo reconstruye
+void completado_actualizar() {
+    cargar_path();
+    for (int i = 0; i < ndirs; i++) {
+        if (dirs[i].sucio) leer_dir(&dirs[i]);
+    }
+    if (indice_sucio) reconstruir_indice();
+}
+
+// Un directorio por vuelta, para no bloquear el prompt
+static void lectura_ociosa(void* datos) {
+    (void)datos;
+    lectura_pendiente = 0;
+    cargar_path();
+    for (int i = 0; i < ndirs; i++) {
+        if (dirs[i].sucio) {
+            leer_dir(&dirs[i]);
+            lectura_pendiente = eventos_timer(ESPERA_OCIOSA_MS, lectura_ociosa, NULL) == 0;
+            return;
+        }
+    }
+    if (indice_sucio) reconstruir_indice();
+}
+
+static void programar_lectura() {
+    if (!lectura_pendiente) {
+        lectura_pendiente = eventos_timer(ESPERA_OCIOSA_MS, lectura_ociosa, NULL) == 0;
+    }
+}
+
+static void cambios_inotify(void* datos) {
+    (void)datos;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            for (int i = 0; i < ndirs; i++) {
+                if (dirs[i].wd == ev->wd) dirs[i].sucio = 1;
+            }
+            if (ev->mask & IN_IGNORED) {
+                // El directorio ya no existe: se vuelve a vigilar si reaparece
+                for (int i = 0; i < ndirs; i++) {
+                    if (dirs[i].wd == ev->wd) dirs[i].wd = -1;
+                }
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    programar_lectura();
+}
+
+void completado_invalidar() {
+    for (int i = 0; i < ndirs; i++) {
+        dirs[i].sucio = 1;
+        if (dirs[i].wd < 0 && inotify_fd >= 0) {
+            dirs[i].wd = inotify_add_watch(inotify_fd, dirs[i].ruta, CAMBIOS);
+        }
+    }
+    indice_sucio = 1;
+    programar_lectura();
+}
+
+// Nombres que empiezan por prefijo: deja en primero la posicion del primero
+// y devuelve cuantos hay
+int completado_buscar(const char* prefijo, int* primero) {
+    if (indice_sucio || dirs == NULL) {
+        completado_actualizar();
+    }
+    size_t largo = strlen(prefijo);
+    int bajo = 0, alto = nindice;
+    while (bajo < alto) {
+        int medio = (bajo + alto) / 2;
+        if (strcmp(indice[medio], prefijo) < 0) bajo = medio + 1;
+        else alto = medio;
+    }
+    *primero = bajo;
+    alto = nindice;
+    int inicio = bajo;
+    while (bajo < alto) {
+        int medio = (bajo + alto) / 2;
+        if (strncmp(indice[medio], prefijo, largo) <= 0) bajo = medio + 1;
+        else alto = medio;
+    }
+    return bajo - inicio;
+}
+
+// Generador para rl_completion_matches
+static char* siguiente_comando(const char* texto, int estado) {
+    static int posicion, quedan;
+    if (estado == 0) {
+        quedan = completado_buscar(texto, &posicion);
+    }
+    if (quedan-- <= 0) {
+        return NULL;
+    }
+    return strdup(indice[posicion++]);
+}
+
+// Primera palabra de la linea o de una etapa (detras de '|'), sin '/'
+static char** completar(const char* texto, int inicio, int fin) {
+    (void)fin;
+    if (strchr(texto, '/')) {
+        return NULL;
+    }
+    int i = inicio;
+    while (i > 0 && (rl_line_buffer[i - 1] == ' ' || rl_line_buffer[i - 1] == '\t')) i--;
+    if (i > 0 && rl_line_buffer[i - 1] != '|') {
+        return NULL;
+    }
+    rl_attempted_completion_over = 1;
+    return rl_completion_matches(texto, siguiente_comando);
+}
+
+void completado_iniciar() {
+    rl_attempted_completion_function = completar;
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0 && eventos_vigilar_fd(inotify_fd, cambios_inotify, NULL) < 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    cargar_path();
+    programar_lectura();
+}
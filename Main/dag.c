@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "parser.h"
+#include "myshell.h"
+
+// run [-j N] [-k] fichero
+//
+// Cada linea del fichero es un nodo con nombre, dependencias y una linea de
+// comandos (con pipes y redirecciones, como en la shell):
+//
+//     # comentario
+//     descargar: ; curl -o datos.csv http://...
+//     limpiar: descargar ; sort -u datos.csv > limpio.csv
+//     informe: limpiar estadisticas ; cat limpio.csv | wc -l > informe.txt
+//
+// Los nodos sin dependencias pendientes se ejecutan a la vez, como mucho N
+// (por defecto las CPUs disponibles). Entre los listos se lanza antes el que
+// tiene el camino mas largo hasta el final del grafo. Un fallo detiene el
+// lanzamiento de nodos nuevos salvo con -k, que sigue con todo lo que no
+// dependa del nodo fallido. Al final se imprime el tiempo de cada nodo.
+
+typedef enum { N_ESPERA, N_LISTO, N_EN_MARCHA, N_OK, N_FALLO } tEstadoNodo;
+
+typedef struct {
+    char* nombre;
+    char* dependencias;     // nombres separados por espacios, hasta resolverlos
+    tline* linea;           // copia propia de lo que devuelve tokenize()
+    int* dependientes;      // nodos que esperan a este
+    int ndependientes;
+    int pendientes;         // dependencias que aun no han terminado bien
+    int prioridad;          // nodos en el camino mas largo desde este
+    tEstadoNodo estado;
+    pid_t* pids;            // etapas de la pipeline en marcha
+    int npids;
+    int vivos;
+    int ultima;             // etapa que es el ultimo comando; -1 si no se lanzo
+    int codigo;             // estado de la ultima etapa
+    double inicio, fin;
+    struct rusage uso;
+} tNodo;
+
+typedef struct {
+    tNodo* nodos;
+    int n;
+    int* orden;             // indices ordenados por nombre, para bsearch
+} tGrafo;
+
+static char* recortar(char* s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char* fin = s + strlen(s);
+    while (fin > s && (fin[-1] == ' ' || fin[-1] == '\t' || fin[-1] == '\n' || fin[-1] == '\r')) {
+        *--fin = '\0';
+    }
+    return s;
+}
+
+static void liberar_grafo(tGrafo* g) {
+    for (int i = 0; i < g->n; i++) {
+        free(g->nodos[i].nombre);
+        free(g->nodos[i].dependencias);
+        free(g->nodos[i].dependientes);
+        free(g->nodos[i].pids);
+        if (g->nodos[i].linea) liberar_tline(g->nodos[i].linea);
+    }
+    free(g->nodos);
+    free(g->orden);
+}
+
+// Busqueda por nombre
+
+static tGrafo* grafo_ordenando = NULL;
+
+static int comparar_nombres(const void* a, const void* b) {
+    return strcmp(grafo_ordenando->nodos[*(const int*)a].nombre,
+                  grafo_ordenando->nodos[*(const int*)b].nombre);
+}
+
+static int buscar_nodo(tGrafo* g, const char* nombre) {
+    int izq = 0, der = g->n - 1;
+    while (izq <= der) {
+        int medio = (izq + der) / 2;
+        int c = strcmp(nombre, g->nodos[g->orden[medio]].nombre);
+        if (c == 0) return g->orden[medio];
+        if (c < 0) der = medio - 1;
+        else izq = medio + 1;
+    }
+    return -1;
+}
+
+static void anadir_dependiente(tNodo* nodo, int dependiente) {
+    if ((nodo->ndependientes & (nodo->ndependientes - 1)) == 0) {
+        int capacidad = nodo->ndependientes ? nodo->ndependientes * 2 : 4;
+        nodo->dependientes = realloc(nodo->dependientes, capacidad * sizeof(int));
+    }
+    nodo->dependientes[nodo->ndependientes++] = dependiente;
+}
+
+// Lectura del fichero. Devuelve -1 (y ya ha informado) si hay algun error
+
+static int leer_grafo(FILE* f, const char* fichero, tGrafo* g) {
+    int capacidad = 0;
+    char* str = NULL;
+    size_t tam = 0;
+    int num_linea = 0;
+    int error = 0;
+
+    while (getline(&str, &tam, f) != -1) {
+        num_linea++;
+        char* p = recortar(str);
+        if (*p == '#' || *p == '\0') {
+            continue;
+        }
+        char* dos_puntos = strchr(p, ':');
+        char* punto_coma = dos_puntos ? strchr(dos_puntos, ';') : NULL;
+        if (punto_coma == NULL) {
+            fprintf(stderr, "%s:%d: se esperaba 'nombre: dependencias ; comando'\n", fichero, num_linea);
+            error = 1;
+            continue;
+        }
+        *dos_puntos = '\0';
+        *punto_coma = '\0';
+        char* nombre = recortar(p);
+        char* comando = recortar(punto_coma + 1);
+
+        tline* linea = tokenize(comando);
+        if (linea == NULL || linea->ncommands == 0 || linea->background) {
+            fprintf(stderr, "%s:%d: %s: comando no valido\n", fichero, num_linea, nombre);
+            error = 1;
+            continue;
+        }
+
+        if (g->n >= capacidad) {
+            capacidad = capacidad ? capacidad * 2 : 32;
+            g->nodos = realloc(g->nodos, capacidad * sizeof(tNodo));
+        }
+        tNodo* nodo = &g->nodos[g->n++];
+        memset(nodo, 0, sizeof(tNodo));
+        nodo->nombre = strdup(nombre);
+        nodo->dependencias = strdup(dos_puntos + 1);
+        nodo->linea = copiar_tline(linea);
+    }
+    free(str);
+    if (error) {
+        return -1;
+    }
+
+    g->orden = malloc((g->n ? g->n : 1) * sizeof(int));
+    for (int i = 0; i < g->n; i++) g->orden[i] = i;
+    grafo_ordenando = g;
+    qsort(g->orden, g->n, sizeof(int), comparar_nombres);
+    for (int i = 1; i < g->n; i++) {
+        if (strcmp(g->nodos[g->orden[i]].nombre, g->nodos[g->orden[i - 1]].nombre) == 0) {
+            fprintf(stderr, "%s: nodo repetido: %s\n", fichero, g->nodos[g->orden[i]].nombre);
+            return -1;
+        }
+    }
+
+    // Aristas: dependencia -> dependiente
+    for (int i = 0; i < g->n; i++) {
+        char* resto = g->nodos[i].dependencias;
+        char* dep;
+        while ((dep = strtok_r(resto, " \t", &resto)) != NULL) {
+            int j = buscar_nodo(g, dep);
+            if (j < 0) {
+                fprintf(stderr, "%s: %s depende de %s, que no existe\n", fichero, g->nodos[i].nombre, dep);
+                return -1;
+            }
+            anadir_dependiente(&g->nodos[j], i);
+            g->nodos[i].pendientes++;
+        }
+    }
+    return 0;
+}
+
+// Orden topologico (Kahn) y prioridad por camino critico. Devuelve -1 si hay un ciclo
+
+static int calcular_prioridades(tGrafo* g) {
+    int* topologico = malloc((g->n ? g->n : 1) * sizeof(int));
+    int* entrantes = malloc((g->n ? g->n : 1) * sizeof(int));
+    int cabeza = 0, cola = 0;
+
+    for (int i = 0; i < g->n; i++) {
+        entrantes[i] = g->nodos[i].pendientes;
+        if (entrantes[i] == 0) topologico[cola++] = i;
+    }
+    while (cabeza < cola) {
+        tNodo* nodo = &g->nodos[topologico[cabeza++]];
+        for (int k = 0; k < nodo->ndependientes; k++) {
+            if (--entrantes[nodo->dependientes[k]] == 0) {
+                topologico[cola++] = nodo->dependientes[k];
+            }
+        }
+    }
+
+    int ciclo = cola < g->n;
+    if (!ciclo) {
+        // En orden inverso: cada nodo ve ya calculados a sus dependientes
+        for (int i = g->n - 1; i >= 0; i--) {
+            tNodo* nodo = &g->nodos[topologico[i]];
+            int maximo = 0;
+            for (int k = 0; k < nodo->ndependientes; k++) {
+                int p = g->nodos[nodo->dependientes[k]].prioridad;
+                if (p > maximo) maximo = p;
+            }
+            nodo->prioridad = 1 + maximo;
+        }
+    } else {
+        for (int i = 0; i < g->n; i++) {
+            if (entrantes[i] > 0) {
+                fprintf(stderr, "run: ciclo de dependencias en %s\n", g->nodos[i].nombre);
+                break;
+            }
+        }
+    }
+    free(topologico);
+    free(entrantes);
+    return ciclo ? -1 : 0;
+}
+
+// Cola de listos: montículo por prioridad; a igualdad, el primero del fichero
+
+static int antes(tGrafo* g, int a, int b) {
+    if (g->nodos[a].prioridad != g->nodos[b].prioridad) {
+        return g->nodos[a].prioridad > g->nodos[b].prioridad;
+    }
+    return a < b;
+}
+
+static void listos_meter(tGrafo* g, int* monticulo, int* n, int nodo) {
+    int i = (*n)++;
+    monticulo[i] = nodo;
+    while (i > 0 && antes(g, monticulo[i], monticulo[(i - 1) / 2])) {
+        int padre = (i - 1) / 2;
+        int tmp = monticulo[i]; monticulo[i] = monticulo[padre]; monticulo[padre] = tmp;
+        i = padre;
+    }
+    g->nodos[nodo].estado = N_LISTO;
+}
+
+static int listos_sacar(tGrafo* g, int* monticulo, int* n) {
+    int cima = monticulo[0];
+    monticulo[0] = monticulo[--(*n)];
+    int i = 0;
+    while (1) {
+        int mejor = i, izq = 2 * i + 1, der = 2 * i + 2;
+        if (izq < *n && antes(g, monticulo[izq], monticulo[mejor])) mejor = izq;
+        if (der < *n && antes(g, monticulo[der], monticulo[mejor])) mejor = der;
+        if (mejor == i) break;
+        int tmp = monticulo[i]; monticulo[i] = monticulo[mejor]; monticulo[mejor] = tmp;
+        i = mejor;
+    }
+    return cima;
+}
+
+static const char* nombre_estado(tEstadoNodo e) {
+    switch (e) {
+        case N_OK: return "ok";
+        case N_FALLO: return "fallo";
+        case N_EN_MARCHA: return "en marcha";
+        default: return "omitido";
+    }
+}
+
+static void informe(tGrafo* g, double inicio, double real, int trabajadores) {
+    int ok = 0, fallos = 0, omitidos = 0, camino = 0;
+    fflush(stdout);
+    for (int i = 0; i < g->n; i++) {
+        tNodo* nodo = &g->nodos[i];
+        if (nodo->prioridad > camino) camino = nodo->prioridad;
+        if (nodo->estado == N_OK) ok++;
+        else if (nodo->estado == N_FALLO) fallos++;
+        else omitidos++;
+
+        if (nodo->estado == N_OK || nodo->estado == N_FALLO) {
+            fprintf(stderr, "  %-20s %-7s estado %-3d inicio %7.3fs real %7.3fs user %.3fs sys %.3fs\n",
+                    nodo->nombre, nombre_estado(nodo->estado), nodo->codigo, nodo->inicio - inicio,
+                    nodo->fin - nodo->inicio,
+                    nodo->uso.ru_utime.tv_sec + nodo->uso.ru_utime.tv_usec / 1e6,
+                    nodo->uso.ru_stime.tv_sec + nodo->uso.ru_stime.tv_usec / 1e6);
+        } else {
+            fprintf(stderr, "  %-20s %s\n", nodo->nombre, nombre_estado(nodo->estado));
+        }
+    }
+    fprintf(stderr, "run: %d nodos, %d ok, %d fallos, %d omitidos en %.3fs (-j %d, camino critico %d)\n",
+            g->n, ok, fallos, omitidos, real, trabajadores, camino);
+}
+
+int manejador_run(tline* linea) {
+    tcommand cmd = linea->commands[0];
+    int trabajadores = cpus_disponibles();
+    int seguir = 0;
+    const char* fichero = NULL;
+
+    for (int i = 1; i < cmd.argc; i++) {
+        if (strcmp(cmd.argv[i], "-k") == 0) {
+            seguir = 1;
+        } else if (strcmp(cmd.argv[i], "-j") == 0 && i + 1 < cmd.argc) {
+            trabajadores = atoi(cmd.argv[++i]);
+        } else if (strncmp(cmd.argv[i], "-j", 2) == 0 && cmd.argv[i][2] != '\0') {
+            trabajadores = atoi(cmd.argv[i] + 2);
+        } else if (cmd.argv[i][0] != '-' && fichero == NULL) {
+            fichero = cmd.argv[i];
+        } else {
+            fichero = NULL;
+            break;
+        }
+    }
+    if (fichero == NULL || trabajadores < 1) {
+        fprintf(stderr, "Uso: run [-j N] [-k] fichero\n");
+        return 2;
+    }
+
+    FILE* f = fopen(fichero, "r");
+    if (f == NULL) {
+        fprintf(stderr, "%s: Error. %s\n", fichero, strerror(errno));
+        return 1;
+    }
+    // leer_grafo llama a tokenize(): con su propia arena, la linea de run
+    // sigue valida para quien la ha ejecutado
+    void* arena_linea = apartar_arena();
+    tGrafo g = {0};
+    int error = leer_grafo(f, fichero, &g);
+    fclose(f);
+    recuperar_arena(arena_linea);
+    if (error == 0) {
+        error = calcular_prioridades(&g);
+    }
+    if (error != 0) {
+        liberar_grafo(&g);
+        return 2;
+    }
+
+    int* monticulo = malloc((g.n ? g.n : 1) * sizeof(int));
+    int* en_marcha = malloc(trabajadores * sizeof(int));
+    int nlistos = 0, nmarcha = 0;
+    int parar = 0;
+    for (int i = 0; i < g.n; i++) {
+        if (g.nodos[i].pendientes == 0) listos_meter(&g, monticulo, &nlistos, i);
+    }
+
+    fflush(stdout);
+    double inicio = tiempo_ahora();
+
+    while (1) {
+        while (!parar && nmarcha < trabajadores && nlistos > 0) {
+            int i = listos_sacar(&g, monticulo, &nlistos);
+            tNodo* nodo = &g.nodos[i];
+            int n = nodo->linea->ncommands;
+            nodo->pids = malloc(n * sizeof(pid_t));
+            char** nombres = malloc(n * sizeof(char*));
+            nodo->inicio = tiempo_ahora();
+            // En el grupo de la shell: Ctrl-C llega a todos los nodos
+            nodo->npids = lanzar_pipeline(nodo->linea, getpgrp(), nodo->pids, nombres);
+            nodo->vivos = nodo->npids;
+            // Sin su ultimo comando el nodo falla con 127 aunque el resto vaya bien
+            int ultima_lanzada = nodo->npids > 0
+                                 && nombres[nodo->npids - 1] == nodo->linea->commands[n - 1].argv[0];
+            nodo->ultima = ultima_lanzada ? nodo->npids - 1 : -1;
+            nodo->codigo = ultima_lanzada ? 0 : 127;
+            free(nombres);
+            if (nodo->npids == 0) {
+                nodo->fin = nodo->inicio;
+                nodo->codigo = 127;
+                nodo->estado = N_FALLO;
+                parar = !seguir;
+                continue;
+            }
+            nodo->estado = N_EN_MARCHA;
+            en_marcha[nmarcha++] = i;
+        }
+        if (nmarcha == 0) {
+            break;
+        }
+
+        int estatus;
+        struct rusage uso;
+        pid_t pid = wait4(-1, &estatus, 0, &uso);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        traza_hijo_fin(pid);
+
+        int posicion = -1, etapa = -1;
+        for (int k = 0; k < nmarcha && posicion < 0; k++) {
+            tNodo* nodo = &g.nodos[en_marcha[k]];
+            for (int e = 0; e < nodo->npids; e++) {
+                if (nodo->pids[e] == pid) { posicion = k; etapa = e; break; }
+            }
+        }
+        if (posicion < 0) {
+            job_proceso_terminado(pid, &uso); // Hijo de un job en segundo plano
+            continue;
+        }
+
+        tNodo* nodo = &g.nodos[en_marcha[posicion]];
+        uso_sumar(&nodo->uso, &uso);
+        if (etapa == nodo->ultima) {
+            nodo->codigo = codigo_salida(estatus);
+        }
+        if (WIFSIGNALED(estatus) && WTERMSIG(estatus) == SIGINT) {
+            parar = 1; // Ctrl-C: no se lanza nada mas, ni con -k
+        }
+        if (--nodo->vivos > 0) {
+            continue;
+        }
+
+        nodo->fin = tiempo_ahora();
+        en_marcha[posicion] = en_marcha[--nmarcha];
+        if (nodo->codigo != 0) {
+            nodo->estado = N_FALLO;
+            if (!seguir) parar = 1;
+            continue; // Sus dependientes quedan sin lanzar
+        }
+        nodo->estado = N_OK;
+        for (int k = 0; k < nodo->ndependientes; k++) {
+            int d = nodo->dependientes[k];
+            if (--g.nodos[d].pendientes == 0) {
+                listos_meter(&g, monticulo, &nlistos, d);
+            }
+        }
+    }
+
+    informe(&g, inicio, tiempo_ahora() - inicio, trabajadores);
+
+    int estado = 0;
+    for (int i = 0; i < g.n; i++) {
+        if (g.nodos[i].estado != N_OK) estado = 1;
+    }
+    free(monticulo);
+    free(en_marcha);
+    liberar_grafo(&g);
+    return estado;
+}
@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include "parser.h"
+#include "myshell.h"
+
+// Telemetria interna: histogramas de latencia de los caminos de la shell.
+//
+// Cada metrica es un histograma log-lineal al estilo HDR: los valores (en ns)
+// se agrupan por potencia de dos y cada potencia en 16 tramos, con lo que el
+// error relativo de un percentil es como mucho del 6% y anotar es un par de
+// operaciones de bits. Desactivada (lo normal) cada punto de medida se queda
+// en comprobar stats_activas y traza_activa: ni se lee el reloj. Los mismos
+// puntos alimentan la traza de eventos (traza.c).
+//
+// Se activa con --stats, MSH_STATS=1 o `stats on`. Con MSH_STATS_JSON=ruta
+// ademas se escribe el JSON en ese fichero al salir y con cada SIGUSR1.
+
+#define TRAMOS_BITS 4
+#define TRAMOS (1 << TRAMOS_BITS)
+#define CUBETAS ((64 - TRAMOS_BITS + 1) * TRAMOS)
+
+typedef struct {
+    uint64_t cuenta[CUBETAS];
+    uint64_t n;
+    uint64_t maximo;
+    uint64_t suma;
+} tHistograma;
+
+static const char* nombres[ST_TOTAL] = {
+    "tokenize", "interna", "lanzar", "tcsetpgrp", "espera", "prompt",
+};
+
+int stats_activas = 0;
+static tHistograma* histogramas = NULL;
+static const char* ruta_json = NULL;
+static pid_t pid_shell = 0;
+static volatile sig_atomic_t volcado_pedido = 0;
+
+uint64_t stats_reloj() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+// Fin de un punto de medida: cada destino activo recibe la suya
+void stats_medida(tMetrica m, uint64_t inicio) {
+    uint64_t fin = stats_reloj();
+    if (stats_activas) stats_anotar(m, fin - inicio);
+    if (traza_activa) traza_evento(nombres[m], inicio, fin, NULL);
+}
+
+static int cubeta(uint64_t v) {
+    if (v < TRAMOS) {
+        return (int)v;
+    }
+    int exponente = 63 - __builtin_clzll(v);
+    int tramo = (int)(v >> (exponente - TRAMOS_BITS)) & (TRAMOS - 1);
+    return (exponente - TRAMOS_BITS + 1) * TRAMOS + tramo;
+}
+
+// Punto medio de los valores que caen en la cubeta
+static uint64_t valor_cubeta(int i) {
+    if (i < TRAMOS) {
+        return i;
+    }
+    int exponente = i / TRAMOS + TRAMOS_BITS - 1;
+    uint64_t ancho = 1ull << (exponente - TRAMOS_BITS);
+    uint64_t inicio = (1ull << exponente) + (uint64_t)(i % TRAMOS) * ancho;
+    return inicio + ancho / 2;
+}
+
+void stats_anotar(tMetrica m, uint64_t ns) {
+    if (histogramas == NULL) {
+        histogramas = calloc(ST_TOTAL, sizeof(tHistograma));
+    }
+    tHistograma* h = &histogramas[m];
+    h->cuenta[cubeta(ns)]++;
+    h->n++;
+    h->suma += ns;
+    if (ns > h->maximo) h->maximo = ns;
+}
+
+static uint64_t percentil(const tHistograma* h, double p) {
+    if (h->n == 0) {
+        return 0;
+    }
+    uint64_t objetivo = (uint64_t)(p / 100.0 * h->n + 0.5);
+    if (objetivo < 1) objetivo = 1;
+    uint64_t acumulado = 0;
+    for (int i = 0; i < CUBETAS; i++) {
+        acumulado += h->cuenta[i];
+        if (acumulado >= objetivo) {
+            uint64_t v = valor_cubeta(i);
+            return v < h->maximo ? v : h->maximo;
+        }
+    }
+    return h->maximo;
+}
+
+static const double PERCENTILES[] = {50, 90, 99, 99.9};
+
+void stats_json(FILE* f) {
+    fprintf(f, "{\"metricas\": [");
+    for (int m = 0; m < ST_TOTAL; m++) {
+        static const tHistograma vacio;
+        const tHistograma* h = histogramas ? &histogramas[m] : &vacio;
+        fprintf(f, "%s\n  {\"nombre\": \"%s\", \"n\": %llu, \"media_ns\": %llu", m ? "," : "",
+                nombres[m], (unsigned long long)h->n,
+                (unsigned long long)(h->n ? h->suma / h->n : 0));
+        fprintf(f, ", \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu",
+                (unsigned long long)percentil(h, 50), (unsigned long long)percentil(h, 90),
+                (unsigned long long)percentil(h, 99), (unsigned long long)percentil(h, 99.9));
+        fprintf(f, ", \"max_ns\": %llu}", (unsigned long long)h->maximo);
+    }
+    fprintf(f, "\n]}\n");
+}
+
+// Se escribe en un temporal y se renombra: quien lo lea nunca ve medio JSON
+static void volcar_json() {
+    if (ruta_json == NULL || getpid() != pid_shell) {
+        return; // Un hijo de fork que sale antes del exec no escribe nada
+    }
+    char temporal[4096];
+    snprintf(temporal, sizeof(temporal), "%s.tmp", ruta_json);
+    FILE* f = fopen(temporal, "we");
+    if (f == NULL) {
+        return;
+    }
+    stats_json(f);
+    if (fclose(f) == 0) rename(temporal, ruta_json);
+}
+
+static void pedir_volcado(int senal) {
+    (void)senal;
+    volcado_pedido = 1;
+}
+
+// Se llama en puntos seguros: tras cada linea y en cada vuelta del bucle
+void stats_atender() {
+    if (volcado_pedido) {
+        volcado_pedido = 0;
+        volcar_json();
+    }
+}
+
+void stats_iniciar() {
+    char* activas = getenv("MSH_STATS");
+    if (activas && strcmp(activas, "1") == 0) {
+        stats_activas = 1;
+    }
+    ruta_json = getenv("MSH_STATS_JSON");
+    if (ruta_json && ruta_json[0] != '\0') {
+        stats_activas = 1;
+        pid_shell = getpid();
+        atexit(volcar_json);
+        struct sigaction sa = {.sa_handler = pedir_volcado, .sa_flags = SA_RESTART};
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, NULL);
+    } else {
+        ruta_json = NULL;
+    }
+}
+
+static void imprimir_duracion(uint64_t ns) {
+    if (ns < 10000) printf(" %8llu ns", (unsigned long long)ns);
+    else if (ns < 10000000) printf(" %8.1f us", ns / 1e3);
+    else printf(" %8.1f ms", ns / 1e6);
+}
+
+// stats [on | off | reset | json]
+
+int manejador_stats(tline* linea) {
+    tcommand cmd = linea->commands[0];
+    if (cmd.argc > 1) {
+        if (strcmp(cmd.argv[1], "on") == 0) {
+            stats_activas = 1;
+        } else if (strcmp(cmd.argv[1], "off") == 0) {
+            stats_activas = 0;
+        } else if (strcmp(cmd.argv[1], "reset") == 0) {
+            if (histogramas) memset(histogramas, 0, ST_TOTAL * sizeof(tHistograma));
+        } else if (strcmp(cmd.argv[1], "json") == 0) {
+            stats_json(stdout);
+        } else {
+            fprintf(stderr, "stats: uso: stats [on | off | reset | json]\n");
+            return 2;
+        }
+        return 0;
+    }
+
+    printf("telemetria %s\n", stats_activas ? "activa" : "desactivada (stats on)");
+    printf("%-10s %8s %11s %11s %11s %11s %11s\n", "metrica", "n", "p50", "p90", "p99", "p99.9", "max");
+    for (int m = 0; m < ST_TOTAL; m++) {
+        if (histogramas == NULL || histogramas[m].n == 0) {
+            printf("%-10s %8d\n", nombres[m], 0);
+            continue;
+        }
+        const tHistograma* h = &histogramas[m];
+        printf("%-10s %8llu", nombres[m], (unsigned long long)h->n);
+        for (size_t p = 0; p < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); p++) {
+            imprimir_duracion(percentil(h, PERCENTILES[p]));
+        }
+        imprimir_duracion(h->maximo);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,428 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <readline/readline.h>
+#include "myshell.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+// Bucle de eventos de la shell interactiva. Un unico epoll atiende:
+//  - la entrada del terminal, que se pasa a readline en modo callback
+//  - SIGINT a traves de un signalfd (sin manejador que pise a readline)
+//  - un pidfd por cada hijo: su salida se recoge con waitid(P_PIDFD)
+//  - la self-pipe de SIGCHLD, para detectar jobs parados en primer plano
+//  - temporizadores timerfd
+//  - descriptores de otros modulos (inotify del completado)
+// Mientras hay un trabajo en primer plano se sigue esperando en el mismo
+// epoll, pero sin la entrada, que pertenece al trabajo
+
+typedef enum { F_ENTRADA, F_SENAL, F_REAPER, F_PIDFD, F_TIMER, F_FD } tTipoFuente;
+
+typedef struct {
+    tTipoFuente tipo;
+    int fd;
+    pid_t pid;
+    int primer_plano;           // pidfd de un comando que la shell esta esperando
+    tResultado* resultado;      // donde dejar estado y rusage (primer plano)
+    void (*funcion)(void* datos);
+    void* datos;
+} tFuente;
+
+static int epoll_fd = -1;
+static int usar_pidfd = 0;      // 0 si el kernel no tiene pidfd_open: se recoge con SIGCHLD
+static int en_prompt = 0;       // readline tiene el prompt en pantalla
+static uint64_t fin_de_linea = 0;  // telemetria: de aqui a que readline pinta el prompt
+static uint64_t prompt_pintado = 0;  // traza: de aqui a que llega la linea
+static tFuente fuente_entrada = {.tipo = F_ENTRADA, .fd = STDIN_FILENO};
+static tFuente fuente_senal = {.tipo = F_SENAL, .fd = -1};
+static tFuente fuente_reaper = {.tipo = F_REAPER, .fd = -1};
+
+// Comando en primer plano: sus pidfds y cuantos quedan por terminar
+static tFuente** fg_fuentes = NULL;
+static int fg_capacidad = 0;
+static int fg_total = 0;
+static int fg_pendientes = 0;
+
+// Procesos en segundo plano sin pidfd (EMFILE): se recogen uno a uno con
+// cada SIGCHLD. wait4(-1) no vale, se llevaria a los que tienen pidfd
+static pid_t* sin_pidfd = NULL;
+static int n_sin_pidfd = 0;
+static int capacidad_sin_pidfd = 0;
+
+static void (*manejador_linea)(char* linea) = NULL;
+
+int eventos_activo() {
+    return epoll_fd >= 0;
+}
+
+static int pidfd_open(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int vigilar(tFuente* f) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = f};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, f->fd, &ev);
+}
+
+static void dejar_de_vigilar(tFuente* f) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, f->fd, NULL);
+}
+
+// Avisos asincronos sin romper la linea que se esta editando
+static void antes_de_imprimir() {
+    if (en_prompt) rl_clear_visible_line();
+}
+
+static void despues_de_imprimir() {
+    fflush(stdout);
+    if (en_prompt) rl_forced_update_display();
+}
+
+int eventos_iniciar() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    // SIGINT llega como evento: se bloquea y se lee del signalfd. Los hijos
+    // lo desbloquean antes del exec
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigprocmask(SIG_BLOCK, &set, NULL);
+    fuente_senal.fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    int prueba = pidfd_open(getpid());
+    usar_pidfd = (prueba >= 0);
+    if (prueba >= 0) close(prueba);
+
+    antes_de_avisar = antes_de_imprimir;
+    despues_de_avisar = despues_de_imprimir;
+
+    fuente_reaper.fd = reaper_fd();
+    vigilar(&fuente_senal);
+    vigilar(&fuente_reaper);
+    return 0;
+}
+
+// Registra un pidfd para cada proceso. primer_plano indica que la shell lo espera
+static void vigilar_pids(const pid_t* pids, int n, int primer_plano, tResultado* resultados) {
+    if (!usar_pidfd) {
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        tFuente* f = calloc(1, sizeof(tFuente));
+        f->tipo = F_PIDFD;
+        f->pid = pids[i];
+        f->primer_plano = primer_plano;
+        f->resultado = resultados ? &resultados[i] : NULL;
+        f->fd = pidfd_open(pids[i]);
+        int vigilado = f->fd >= 0 && vigilar(f) == 0;
+        if (!vigilado) {
+            if (f->fd >= 0) close(f->fd);
+            f->fd = -1;
+            if (!primer_plano) {
+                free(f);
+                // Sin pidfd: lo recogera el reaper de SIGCHLD
+                if (n_sin_pidfd >= capacidad_sin_pidfd) {
+                    capacidad_sin_pidfd = capacidad_sin_pidfd ? capacidad_sin_pidfd * 2 : 16;
+                    sin_pidfd = realloc(sin_pidfd, capacidad_sin_pidfd * sizeof(pid_t));
+                }
+                sin_pidfd[n_sin_pidfd++] = pids[i];
+                continue;
+            }
+            // Sin descriptores libres (pipeline muy larga): se espera con
+            // wait4 cuando terminen los vigilados
+        }
+        if (primer_plano) {
+            if (fg_total >= fg_capacidad) {
+                fg_capacidad = fg_capacidad ? fg_capacidad * 2 : 16;
+                fg_fuentes = realloc(fg_fuentes, fg_capacidad * sizeof(tFuente*));
+            }
+            fg_fuentes[fg_total++] = f;
+            if (vigilado) fg_pendientes++;
+        }
+    }
+}
+
+static void recoger_sin_pidfd() {
+    for (int i = 0; i < n_sin_pidfd; i++) {
+        int estatus;
+        struct rusage uso;
+        pid_t r = wait4(sin_pidfd[i], &estatus, WNOHANG, &uso);
+        if (r == 0) {
+            continue;
+        }
+        // Recogido (o ya no es hijo nuestro): fuera de la lista
+        pid_t pid = sin_pidfd[i];
+        sin_pidfd[i--] = sin_pidfd[--n_sin_pidfd];
+        if (r > 0) {
+            traza_hijo_fin(pid);
+            job_proceso_terminado(pid, &uso);
+        }
+    }
+}
+
+void eventos_vigilar_job(const pid_t* pids, int n) {
+    if (eventos_activo()) {
+        vigilar_pids(pids, n, 0, NULL);
+    }
+}
+
+static void pidfd_listo(tFuente* f) {
+    siginfo_t info;
+    struct rusage uso;
+    memset(&info, 0, sizeof(info));
+    memset(&uso, 0, sizeof(uso));
+    // La llamada al sistema waitid acepta un rusage que glibc no expone.
+    // ECHILD: ya lo recogio otro (fg fuera del bucle); se trata igual
+    syscall(SYS_waitid, P_PIDFD, f->fd, &info, WEXITED | WNOHANG, &uso);
+    traza_hijo_fin(f->pid);
+    int codigo = (info.si_code == CLD_EXITED) ? info.si_status
+               : (info.si_pid != 0) ? 128 + info.si_status : 0;
+
+    dejar_de_vigilar(f);
+    close(f->fd);
+
+    if (f->primer_plano) {
+        fg_pendientes--;
+        for (int i = 0; i < fg_total; i++) {
+            if (fg_fuentes[i] == f) fg_fuentes[i] = NULL;
+        }
+        if (f->resultado) {
+            f->resultado->estado = codigo;
+            f->resultado->uso = uso;
+        }
+    } else {
+        job_proceso_terminado(f->pid, &uso);
+    }
+    free(f);
+}
+
+static void timer_listo(tFuente* f) {
+    unsigned long long expiraciones;
+    read(f->fd, &expiraciones, sizeof(expiraciones));
+    dejar_de_vigilar(f);
+    close(f->fd);
+    f->funcion(f->datos);
+    free(f);
+}
+
+// Temporizador de un solo disparo; la funcion se llama desde el bucle. No
+// debe imprimir: puede saltar con el prompt en pantalla y no se redibuja
+int eventos_timer(int ms, void (*funcion)(void* datos), void* datos) {
+    if (!eventos_activo()) {
+        return -1;
+    }
+    tFuente* f = calloc(1, sizeof(tFuente));
+    f->tipo = F_TIMER;
+    f->funcion = funcion;
+    f->datos = datos;
+    f->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec t = {.it_value = {ms / 1000, (ms % 1000) * 1000000L}};
+    if (f->fd < 0 || timerfd_settime(f->fd, 0, &t, NULL) < 0 || vigilar(f) < 0) {
+        if (f->fd >= 0) close(f->fd);
+        free(f);
+        return -1;
+    }
+    return 0;
+}
+
+// Descriptor que se vigila mientras dure la shell; la funcion se llama cada
+// vez que tiene datos y, como la de un timer, no debe imprimir
+int eventos_vigilar_fd(int fd, void (*funcion)(void* datos), void* datos) {
+    if (!eventos_activo()) {
+        return -1;
+    }
+    tFuente* f = calloc(1, sizeof(tFuente));
+    f->tipo = F_FD;
+    f->fd = fd;
+    f->funcion = funcion;
+    f->datos = datos;
+    if (vigilar(f) < 0) {
+        free(f);
+        return -1;
+    }
+    return 0;
+}
+
+// Atiende un lote de eventos. Devuelve 1 si el grupo pgid se ha parado
+static int atender_eventos(pid_t pgid) {
+    struct epoll_event eventos[64];
+    int n = epoll_wait(epoll_fd, eventos, 64, -1);
+    int parado = 0;
+
+    for (int i = 0; i < n; i++) {
+        tFuente* f = eventos[i].data.ptr;
+        switch (f->tipo) {
+            case F_ENTRADA:
+                // La linea puede ejecutar un comando que espere en un bucle
+                // anidado y libere fuentes de este lote: el resto se vuelve a
+                // notificar en la siguiente vuelta
+                rl_callback_read_char();
+                if (fin_de_linea) {
+                    stats_fin(ST_PROMPT, fin_de_linea);
+                    fin_de_linea = 0;
+                    if (traza_activa) prompt_pintado = stats_reloj();
+                }
+                return 0;
+            case F_SENAL: {
+                struct signalfd_siginfo info;
+                while (read(f->fd, &info, sizeof(info)) > 0) {
+                    if (en_prompt) manejador_CrtlC();
+                }
+                break;
+            }
+            case F_REAPER:
+                if (reaper_drenar() && pgid > 0) {
+                    // SIGCHLD por una parada: ¿es del trabajo en primer plano?
+                    siginfo_t info;
+                    memset(&info, 0, sizeof(info));
+                    waitid(P_PGID, pgid, &info, WSTOPPED | WNOHANG);
+                    if (info.si_pid != 0) parado = 1;
+                }
+                if (!usar_pidfd) {
+                    recoger_hijos();
+                } else if (n_sin_pidfd > 0) {
+                    recoger_sin_pidfd();
+                }
+                break;
+            case F_PIDFD:
+                pidfd_listo(f);
+                break;
+            case F_TIMER:
+                timer_listo(f);
+                break;
+            case F_FD:
+                f->funcion(f->datos);
+                break;
+        }
+    }
+    return parado;
+}
+
+// Espera a un comando recien lanzado en primer plano. Devuelve 1 si se paro
+// (Ctrl-Z); en ese caso pids y n quedan con los procesos que siguen vivos,
+// cuyos pidfds pasan a ser del job en segundo plano. Si resultados no es NULL
+// recibe el estado y el rusage de cada proceso, en el orden de pids
+static int esperar_grupo(pid_t pgid, pid_t* pids, int* n, tResultado* resultados) {
+    if (resultados) {
+        memset(resultados, 0, *n * sizeof(tResultado));
+    }
+    if (!eventos_activo() || !usar_pidfd) {
+        for (int i = 0; i < *n; i++) {
+            int estatus = 0;
+            struct rusage uso;
+            if (tuberias_vigiladas()) {
+                esperar_muestreando(pids[i], &estatus, &uso);
+            } else {
+                wait4(pids[i], &estatus, 0, &uso);
+            }
+            traza_hijo_fin(pids[i]);
+            if (resultados) {
+                resultados[i].estado = codigo_salida(estatus);
+                resultados[i].uso = uso;
+            }
+        }
+        return 0;
+    }
+
+    fg_total = 0;
+    fg_pendientes = 0;
+    vigilar_pids(pids, *n, 1, resultados);
+
+    int parado = 0;
+    while (fg_pendientes > 0 && !parado) {
+        parado = atender_eventos(pgid);
+    }
+
+    int vivos = 0;
+    for (int i = 0; i < fg_total; i++) {
+        tFuente* f = fg_fuentes[i];
+        if (f && f->fd < 0 && !parado) {
+            int estatus = 0;
+            struct rusage uso;
+            wait4(f->pid, &estatus, 0, &uso);
+            traza_hijo_fin(f->pid);
+            if (f->resultado) {
+                f->resultado->estado = codigo_salida(estatus);
+                f->resultado->uso = uso;
+            }
+            free(f);
+            fg_fuentes[i] = NULL;
+        }
+        if (fg_fuentes[i]) {
+            fg_fuentes[i]->primer_plano = 0;
+            pids[vivos++] = fg_fuentes[i]->pid;
+            if (fg_fuentes[i]->fd < 0) free(fg_fuentes[i]); // Sin pidfd que pase al job
+        }
+    }
+    *n = vivos;
+    fg_total = 0;
+    fg_pendientes = 0;
+    return parado;
+}
+
+int esperar_primer_plano(pid_t pgid, pid_t* pids, int* n, tResultado* resultados) {
+    uint64_t inicio = stats_inicio();
+    int parado = esperar_grupo(pgid, pids, n, resultados);
+    stats_fin(ST_ESPERA, inicio);
+    return parado;
+}
+
+// fg: el job ya tiene sus pidfds; se espera a que desaparezca de la tabla
+int esperar_job_primer_plano(tJob* job) {
+    pid_t pgid = job->pgid;
+    job->primer_plano = 1;
+
+    int parado = 0;
+    while (!parado && getJobxPgid(pgid) != NULL) {
+        parado = atender_eventos(pgid);
+    }
+    if (parado) {
+        job = getJobxPgid(pgid);
+        job->primer_plano = 0;
+        job->parado = 1;
+    }
+    return parado;
+}
+
+static void linea_leida(char* linea) {
+    en_prompt = 0;
+    if (prompt_pintado) {
+        traza_evento("readline", prompt_pintado, stats_reloj(), NULL);
+        prompt_pintado = 0;
+    }
+    // Mientras se ejecuta, la entrada es del trabajo en primer plano
+    dejar_de_vigilar(&fuente_entrada);
+    manejador_linea(linea);
+    vigilar(&fuente_entrada);
+    en_prompt = 1;
+    // readline vuelve a pintar el prompt al volver de este callback
+    fin_de_linea = stats_inicio();
+}
+
+void eventos_bucle(const char* prompt, void (*manejador)(char* linea)) {
+    manejador_linea = manejador;
+    rl_callback_handler_install(prompt, linea_leida);
+    prompt_pintado = traza_activa ? stats_reloj() : 0;
+    vigilar(&fuente_entrada);
+    en_prompt = 1;
+
+    while (1) {
+        atender_eventos(0);
+        stats_atender();
+    }
+}
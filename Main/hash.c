@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "myshell.h"
+
+// Tabla hash de comandos al estilo de bash: nombre -> ruta absoluta.
+// Los fallos tambien se guardan (ruta NULL) para que un comando mal escrito
+// no vuelva a recorrer todo el PATH. La tabla se vacia si cambia PATH o si
+// cambia el mtime de alguno de sus directorios.
+
+#define PATH_POR_DEFECTO "/bin:/usr/bin" // El mismo que usa execvp si no hay PATH
+
+typedef struct {
+    char* nombre;   // NULL si la casilla esta libre
+    char* ruta;     // NULL si el comando no existe (cache negativa)
+    unsigned hits;
+} tEntradaHash;
+
+typedef struct {
+    char* ruta;
+    struct timespec mtime;
+    int existe;
+} tDirPath;
+
+static tEntradaHash* tabla = NULL;
+static int tabla_capacidad = 0;
+static int tabla_usadas = 0;
+
+static char* path_guardado = NULL;
+static tDirPath* dirs = NULL;
+static int n_dirs = 0;
+static int dirs_relativos = 0;   // Con "." o vacios en PATH el resultado depende del cwd
+static int revalidado = 0;       // Los mtimes se comprueban una vez por linea
+
+// Con directorios relativos las rutas no van a la tabla; se guardan aqui para
+// que sigan validas hasta la siguiente linea
+static char** sin_cache = NULL;
+static int n_sin_cache = 0;
+static int capacidad_sin_cache = 0;
+
+// FNV-1a
+static unsigned hash_cadena(const char* s) {
+    unsigned h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void hash_vaciar(void) {
+    for (int i = 0; i < tabla_capacidad; i++) {
+        free(tabla[i].nombre);
+        free(tabla[i].ruta);
+        tabla[i].nombre = NULL;
+        tabla[i].ruta = NULL;
+    }
+    tabla_usadas = 0;
+}
+
+static void leer_mtime(tDirPath* d) {
+    struct stat st;
+    d->existe = (stat(d->ruta, &st) == 0);
+    if (d->existe) d->mtime = st.st_mtim;
+}
+
+// Trocea PATH en directorios y guarda su mtime actual
+static void cargar_path(const char* path) {
+    for (int i = 0; i < n_dirs; i++) free(dirs[i].ruta);
+    free(dirs);
+    free(path_guardado);
+    dirs = NULL;
+    n_dirs = 0;
+    dirs_relativos = 0;
+    path_guardado = strdup(path);
+
+    int maximo = 1;
+    for (const char* p = path; *p; p++) {
+        if (*p == ':') maximo++;
+    }
+    dirs = calloc(maximo, sizeof(tDirPath));
+
+    const char* inicio = path;
+    while (1) {
+        const char* fin = strchr(inicio, ':');
+        size_t len = fin ? (size_t)(fin - inicio) : strlen(inicio);
+        // Un componente vacio significa el directorio actual
+        dirs[n_dirs].ruta = (len == 0) ? strdup(".") : strndup(inicio, len);
+        if (dirs[n_dirs].ruta[0] != '/') dirs_relativos = 1;
+        leer_mtime(&dirs[n_dirs]);
+        n_dirs++;
+        if (!fin) break;
+        inicio = fin + 1;
+    }
+}
+
+// Comprueba que PATH y sus directorios no han cambiado desde la ultima vez
+static void validar_cache(void) {
+    const char* path = getenv("PATH");
+    if (path == NULL) path = PATH_POR_DEFECTO;
+
+    if (path_guardado == NULL || strcmp(path, path_guardado) != 0) {
+        cargar_path(path);
+        hash_vaciar();
+        revalidado = 1;
+        return;
+    }
+    if (revalidado) {
+        return;
+    }
+    revalidado = 1;
+    for (int i = 0; i < n_dirs; i++) {
+        tDirPath antes = dirs[i];
+        leer_mtime(&dirs[i]);
+        if (antes.existe != dirs[i].existe
+            || antes.mtime.tv_sec != dirs[i].mtime.tv_sec
+            || antes.mtime.tv_nsec != dirs[i].mtime.tv_nsec) {
+            hash_vaciar();
+        }
+    }
+}
+
+void hash_nueva_linea(void) {
+    revalidado = 0;
+    for (int i = 0; i < n_sin_cache; i++) free(sin_cache[i]);
+    n_sin_cache = 0;
+}
+
+static tEntradaHash* casilla(const char* nombre) {
+    unsigned i = hash_cadena(nombre) & (tabla_capacidad - 1);
+    while (tabla[i].nombre && strcmp(tabla[i].nombre, nombre) != 0) {
+        i = (i + 1) & (tabla_capacidad - 1);
+    }
+    return &tabla[i];
+}
+
+static void crecer_tabla(void) {
+    tEntradaHash* vieja = tabla;
+    int vieja_capacidad = tabla_capacidad;
+
+    tabla_capacidad = (tabla_capacidad == 0) ? 64 : tabla_capacidad * 2;
+    tabla = calloc(tabla_capacidad, sizeof(tEntradaHash));
+    for (int i = 0; i < vieja_capacidad; i++) {
+        if (vieja[i].nombre) *casilla(vieja[i].nombre) = vieja[i];
+    }
+    free(vieja);
+}
+
+// Recorre PATH como execvp: primer fichero regular ejecutable
+static char* resolver(const char* nombre) {
+    char ruta[4096];
+    struct stat st;
+
+    for (int i = 0; i < n_dirs; i++) {
+        if (!dirs[i].existe) continue;
+        snprintf(ruta, sizeof(ruta), "%s/%s", dirs[i].ruta, nombre);
+        if (stat(ruta, &st) == 0 && S_ISREG(st.st_mode) && access(ruta, X_OK) == 0) {
+            return strdup(ruta);
+        }
+    }
+    return NULL;
+}
+
+const char* hash_buscar(const char* nombre) {
+    // Las rutas con '/' no se buscan en PATH
+    if (strchr(nombre, '/')) {
+        return nombre;
+    }
+    validar_cache();
+
+    // Con directorios relativos en PATH el resultado no se puede guardar
+    if (dirs_relativos) {
+        char* ruta = resolver(nombre);
+        if (ruta == NULL) return NULL;
+        if (n_sin_cache == capacidad_sin_cache) {
+            capacidad_sin_cache = capacidad_sin_cache ? capacidad_sin_cache * 2 : 8;
+            sin_cache = realloc(sin_cache, capacidad_sin_cache * sizeof(char*));
+        }
+        sin_cache[n_sin_cache++] = ruta;
+        return ruta;
+    }
+
+    if (tabla_capacidad == 0 || 2 * (tabla_usadas + 1) > tabla_capacidad) {
+        crecer_tabla();
+    }
+    tEntradaHash* e = casilla(nombre);
+    if (e->nombre == NULL) {
+        e->nombre = strdup(nombre);
+        e->ruta = resolver(nombre);
+        e->hits = 0;
+        tabla_usadas++;
+    }
+    e->hits++;
+    return e->ruta;
+}
+
+int hash_listar(void) {
+    int hay = 0;
+    for (int i = 0; i < tabla_capacidad; i++) {
+        if (tabla[i].nombre && tabla[i].ruta) {
+            if (!hay) printf("hits\tcommand\n");
+            printf("%4u\t%s\n", tabla[i].hits, tabla[i].ruta);
+            hay = 1;
+        }
+    }
+    if (!hay) printf("hash: tabla vacia\n");
+    return 0;
+}
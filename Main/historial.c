@@ -0,0 +1,478 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <readline/readline.h>
+#include <readline/history.h>
+#include "parser.h"
+#include "myshell.h"
+
+// Historial persistente e indexado.
+//
+// El fichero (MSH_HISTFILE o ~/.msh_history) tiene una linea por comando y
+// solo se le añade al final: cada comando es un unico write con O_APPEND bajo
+// flock compartido, asi que varias shells pueden escribir a la vez sin
+// mezclar lineas. Al arrancar se proyecta con mmap y solo se recorren las
+// ultimas lineas para las flechas de readline; el indice se construye por
+// trozos desde el bucle de eventos cuando la shell esta ociosa (o de golpe en
+// la primera busqueda).
+//
+// Cada entrada tiene un id creciente. Las repetidas se quedan solo con la
+// mas reciente (tabla hash por texto) y el indice de trigramas guarda, para
+// cada trigrama, la lista ordenada de ids que lo contienen: una busqueda
+// recorre hacia atras la lista mas corta de los trigramas de la consulta y
+// comprueba cada candidata, asi que no depende del tamaño del historial.
+
+#define CUBOS (1 << 16)         // listas de trigramas (hash de 3 bytes)
+#define LOTE_OCIOSO 4096        // entradas indexadas por vuelta del bucle
+#define ESPERA_OCIOSA_MS 5
+#define LINEAS_READLINE 1000    // las ultimas, para las flechas
+#define COMPACTAR_DESDE (1 << 20)
+
+typedef struct {
+    const char* texto;          // en el mapa o, si es de esta sesion, malloc
+    uint32_t largo;
+    uint32_t vivo;              // 0 si hay una entrada posterior igual
+} tEntrada;
+
+typedef struct {
+    uint32_t* ids;
+    uint32_t n, capacidad;
+} tLista;
+
+static char* ruta = NULL;
+static const char* mapa = NULL;
+static size_t tam_mapa = 0;
+static size_t leido = 0;        // bytes del mapa ya indexados
+
+static tEntrada* entradas = NULL;
+static int nentradas = 0, capacidad_entradas = 0, nvivas = 0;
+static tLista* cubos = NULL;
+static int32_t* tabla = NULL;   // ids por hash del texto, -1 libre
+static uint32_t capacidad_tabla = 0;
+
+// Lineas de esta sesion llegadas antes de terminar de indexar el mapa: los
+// ids tienen que seguir el orden del fichero
+static char** pendientes = NULL;
+static int npendientes = 0, capacidad_pendientes = 0;
+static char* ultima = NULL;     // no se repite la linea anterior en el fichero
+
+static uint32_t hash_texto(const char* s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static inline uint32_t cubo(const char* s) {
+    uint32_t t = (unsigned char)s[0] | (unsigned char)s[1] << 8 | (unsigned char)s[2] << 16;
+    return (t * 2654435761u) >> 16;
+}
+
+static void tabla_crecer() {
+    uint32_t vieja = capacidad_tabla;
+    int32_t* anterior = tabla;
+    capacidad_tabla = vieja ? vieja * 2 : 1024;
+    tabla = malloc(capacidad_tabla * sizeof(int32_t));
+    memset(tabla, 0xff, capacidad_tabla * sizeof(int32_t));
+    for (uint32_t i = 0; i < vieja; i++) {
+        int32_t id = anterior[i];
+        if (id < 0) continue;
+        uint32_t j = hash_texto(entradas[id].texto, entradas[id].largo) & (capacidad_tabla - 1);
+        while (tabla[j] >= 0) j = (j + 1) & (capacidad_tabla - 1);
+        tabla[j] = id;
+    }
+    free(anterior);
+}
+
+// Da de alta una entrada con el siguiente id
+static void indexar_entrada(const char* texto, uint32_t largo) {
+    if (nentradas >= capacidad_entradas) {
+        capacidad_entradas = capacidad_entradas ? capacidad_entradas * 2 : 1024;
+        entradas = realloc(entradas, capacidad_entradas * sizeof(tEntrada));
+    }
+    int id = nentradas++;
+    entradas[id] = (tEntrada){texto, largo, 1};
+    nvivas++;
+
+    // Repetida: solo cuenta la mas reciente
+    if ((uint32_t)nvivas * 2 >= capacidad_tabla) {
+        tabla_crecer();
+    }
+    uint32_t j = hash_texto(texto, largo) & (capacidad_tabla - 1);
+    while (tabla[j] >= 0) {
+        tEntrada* otra = &entradas[tabla[j]];
+        if (otra->largo == largo && memcmp(otra->texto, texto, largo) == 0) {
+            otra->vivo = 0;
+            nvivas--;
+            break;
+        }
+        j = (j + 1) & (capacidad_tabla - 1);
+    }
+    tabla[j] = id;
+
+    if (cubos == NULL) {
+        cubos = calloc(CUBOS, sizeof(tLista));
+    }
+    for (uint32_t i = 0; i + 3 <= largo; i++) {
+        tLista* l = &cubos[cubo(texto + i)];
+        if (l->n > 0 && l->ids[l->n - 1] == (uint32_t)id) {
+            continue; // trigrama repetido en la misma linea
+        }
+        if (l->n >= l->capacidad) {
+            l->capacidad = l->capacidad ? l->capacidad * 2 : 4;
+            l->ids = realloc(l->ids, l->capacidad * sizeof(uint32_t));
+        }
+        l->ids[l->n++] = id;
+    }
+}
+
+int historial_abrir(const char* fichero) {
+    free(ruta);
+    ruta = strdup(fichero);
+
+    int fd = open(ruta, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1; // se crea con la primera linea
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            mapa = p;
+            tam_mapa = st.st_size;
+        }
+    }
+    close(fd);
+    return mapa || tam_mapa == 0 ? 0 : -1;
+}
+
+// Indexa hasta maximo lineas del mapa. Devuelve 1 si aun quedan
+int historial_indexar(int maximo) {
+    while (leido < tam_mapa && maximo-- > 0) {
+        const char* inicio = mapa + leido;
+        const char* fin = memchr(inicio, '\n', tam_mapa - leido);
+        if (fin == NULL) fin = mapa + tam_mapa;
+        if (fin > inicio) {
+            indexar_entrada(inicio, fin - inicio);
+        }
+        leido = fin - mapa + 1;
+    }
+    if (leido < tam_mapa) {
+        return 1;
+    }
+    leido = tam_mapa;
+    // El mapa ya esta: detras van las lineas de esta sesion
+    for (int i = 0; i < npendientes; i++) {
+        indexar_entrada(pendientes[i], strlen(pendientes[i]));
+    }
+    npendientes = 0;
+    return 0;
+}
+
+static void indexar_todo() {
+    while (historial_indexar(1 << 30)) {
+    }
+}
+
+static void indexado_ocioso(void* datos) {
+    (void)datos;
+    if (historial_indexar(LOTE_OCIOSO)) {
+        eventos_timer(ESPERA_OCIOSA_MS, indexado_ocioso, NULL);
+    }
+}
+
+// Escribe la linea al final del fichero. Si otra shell ha compactado el
+// fichero entre el open y el flock, se vuelve a abrir el nuevo
+static void escribir_linea(const char* linea) {
+    for (int intento = 0; intento < 3; intento++) {
+        int fd = open(ruta, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return;
+        }
+        struct stat abierto, actual;
+        flock(fd, LOCK_SH);
+        if (fstat(fd, &abierto) == 0 && stat(ruta, &actual) == 0 && abierto.st_ino == actual.st_ino) {
+            struct iovec partes[2] = {{(void*)linea, strlen(linea)}, {"\n", 1}};
+            writev(fd, partes, 2);
+            close(fd);
+            return;
+        }
+        close(fd);
+    }
+}
+
+void historial_anadir(const char* linea) {
+    if (ruta == NULL || linea[0] == '\0' || strchr(linea, '\n')) {
+        return;
+    }
+    if (ultima && strcmp(ultima, linea) == 0) {
+        return;
+    }
+    free(ultima);
+    ultima = strdup(linea);
+    escribir_linea(linea);
+
+    char* copia = strdup(linea);
+    if (leido < tam_mapa) {
+        if (npendientes >= capacidad_pendientes) {
+            capacidad_pendientes = capacidad_pendientes ? capacidad_pendientes * 2 : 16;
+            pendientes = realloc(pendientes, capacidad_pendientes * sizeof(char*));
+        }
+        pendientes[npendientes++] = copia;
+    } else {
+        indexar_entrada(copia, strlen(copia));
+    }
+}
+
+int historial_total() {
+    indexar_todo();
+    return nentradas;
+}
+
+const char* historial_texto(int id, size_t* largo) {
+    *largo = entradas[id].largo;
+    return entradas[id].texto;
+}
+
+static int coincide(const tEntrada* e, const char* texto, size_t largo, int prefijo) {
+    if (!e->vivo || e->largo < largo) {
+        return 0;
+    }
+    if (prefijo) {
+        return memcmp(e->texto, texto, largo) == 0;
+    }
+    return memmem(e->texto, e->largo, texto, largo) != NULL;
+}
+
+// Entrada mas reciente con id < antes que contiene texto (o empieza por el,
+// con prefijo). -1 si no hay
+int historial_buscar(const char* texto, int antes, int prefijo) {
+    indexar_todo();
+    size_t largo = strlen(texto);
+    if (antes > nentradas) antes = nentradas;
+    if (largo == 0) {
+        return -1;
+    }
+
+    // Consultas de menos de tres bytes: casi cualquier linea reciente vale
+    if (largo < 3 || cubos == NULL) {
+        for (int id = antes - 1; id >= 0; id--) {
+            if (coincide(&entradas[id], texto, largo, prefijo)) return id;
+        }
+        return -1;
+    }
+
+    tLista* mejor = NULL;
+    for (size_t i = 0; i + 3 <= largo; i++) {
+        tLista* l = &cubos[cubo(texto + i)];
+        if (mejor == NULL || l->n < mejor->n) mejor = l;
+    }
+    // Primera posicion de la lista con id >= antes
+    uint32_t bajo = 0, alto = mejor->n;
+    while (bajo < alto) {
+        uint32_t medio = (bajo + alto) / 2;
+        if (mejor->ids[medio] < (uint32_t)antes) bajo = medio + 1;
+        else alto = medio;
+    }
+    for (uint32_t k = bajo; k-- > 0;) {
+        uint32_t id = mejor->ids[k];
+        if (coincide(&entradas[id], texto, largo, prefijo)) return id;
+    }
+    return -1;
+}
+
+// Ctrl-R: busqueda incremental hacia atras con el indice. Mientras dura se
+// leen las teclas directamente; cualquier tecla que no sea de la busqueda la
+// termina, dejando la linea encontrada, y se procesa con normalidad
+
+static void mostrar_entrada(int id) {
+    size_t largo;
+    const char* texto = historial_texto(id, &largo);
+    char* linea = strndup(texto, largo);
+    rl_replace_line(linea, 0);
+    free(linea);
+}
+
+static int busqueda_incremental(int cuenta, int tecla) {
+    (void)cuenta; (void)tecla;
+    char consulta[256] = "";
+    size_t largo = 0;
+    int actual = -1;
+    int fallida = 0;
+    char* original = strdup(rl_line_buffer);
+
+    rl_save_prompt();
+    while (1) {
+        if (actual >= 0) {
+            mostrar_entrada(actual);
+            const char* p = strstr(rl_line_buffer, consulta);
+            rl_point = p ? (int)(p - rl_line_buffer) : 0;
+        }
+        rl_message("(busqueda%s)`%s': ", fallida ? " fallida" : "", consulta);
+
+        int c = rl_read_key();
+        int encontrada;
+        if (c == CTRL('r')) {
+            // Siguiente coincidencia mas antigua
+            encontrada = largo ? historial_buscar(consulta, actual >= 0 ? actual : nentradas, 0) : -1;
+        } else if (c == RUBOUT || c == CTRL('h')) {
+            if (largo > 0) consulta[--largo] = '\0';
+            encontrada = historial_buscar(consulta, nentradas, 0);
+            if (largo == 0) {
+                actual = -1;
+                rl_replace_line(original, 0);
+            }
+        } else if (c == CTRL('g')) {
+            rl_replace_line(original, 0);
+            rl_point = rl_end;
+            break;
+        } else if ((c >= ' ' && c != RUBOUT) && largo + 1 < sizeof(consulta)) {
+            // La coincidencia actual sigue valiendo si contiene la nueva consulta
+            consulta[largo++] = (char)c;
+            consulta[largo] = '\0';
+            encontrada = historial_buscar(consulta, actual >= 0 ? actual + 1 : nentradas, 0);
+        } else {
+            rl_execute_next(c); // Enter, flechas, Ctrl-A...: se aplican a la linea
+            break;
+        }
+        fallida = largo > 0 && encontrada < 0;
+        if (encontrada >= 0) actual = encontrada;
+    }
+    rl_restore_prompt();
+    rl_clear_message();
+    free(original);
+    return 0;
+}
+
+// Las ultimas lineas del fichero, para recorrerlas con las flechas
+static void cargar_en_readline() {
+    const char* fin = mapa + tam_mapa;
+    const char* p = fin;
+    int n = 0;
+    while (p > mapa && n < LINEAS_READLINE) {
+        p--;
+        if (p > mapa && p[-1] != '\n') continue;
+        n++;
+    }
+    while (p < fin) {
+        const char* salto = memchr(p, '\n', fin - p);
+        if (salto == NULL) salto = fin;
+        if (salto > p) {
+            char* linea = strndup(p, salto - p);
+            add_history(linea);
+            free(linea);
+        }
+        p = salto + 1;
+    }
+}
+
+void historial_iniciar() {
+    char fichero[4096];
+    const char* env = getenv("MSH_HISTFILE");
+    const char* home = getenv("HOME");
+    if (env) {
+        snprintf(fichero, sizeof(fichero), "%s", env);
+    } else if (home) {
+        snprintf(fichero, sizeof(fichero), "%s/.msh_history", home);
+    } else {
+        return;
+    }
+    if (fichero[0] == '\0' || historial_abrir(fichero) < 0) {
+        return;
+    }
+    cargar_en_readline();
+    rl_bind_key(CTRL('r'), busqueda_incremental);
+    eventos_timer(ESPERA_OCIOSA_MS, indexado_ocioso, NULL);
+}
+
+// Al salir: si mas de la mitad del fichero son repetidas se reescribe solo
+// con las vivas. Lo que otras shells hayan añadido despues del mmap (y lo de
+// esta sesion) se copia tal cual detras
+void historial_cerrar() {
+    // Sin el indice completo no se sabe que sobra, y no se construye al salir
+    if (ruta == NULL || leido < tam_mapa || tam_mapa < COMPACTAR_DESDE || nentradas - nvivas <= nvivas) {
+        return;
+    }
+    int fd = open(ruta, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    flock(fd, LOCK_EX);
+    struct stat st;
+    char temporal[4096 + 8];
+    snprintf(temporal, sizeof(temporal), "%s.tmp", ruta);
+    FILE* f = NULL;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= tam_mapa && (f = fopen(temporal, "we"))) {
+        for (int id = 0; id < nentradas; id++) {
+            const tEntrada* e = &entradas[id];
+            if (e->vivo && e->texto >= mapa && e->texto < mapa + tam_mapa) {
+                fwrite(e->texto, 1, e->largo, f);
+                fputc('\n', f);
+            }
+        }
+        char buf[65536];
+        ssize_t n;
+        lseek(fd, tam_mapa, SEEK_SET);
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            fwrite(buf, 1, n, f);
+        }
+        if (fclose(f) == 0) {
+            rename(temporal, ruta);
+        } else {
+            unlink(temporal);
+        }
+    }
+    close(fd); // suelta el flock
+}
+
+// history [N] | history -s texto [N] | history -p prefijo [N]: las N ultimas
+// entradas (o coincidencias), de mas antigua a mas reciente
+
+int manejador_history(tline* linea) {
+    tcommand cmd = linea->commands[0];
+    const char* texto = NULL;
+    int prefijo = 0;
+    int i = 1;
+    if (i < cmd.argc && (strcmp(cmd.argv[i], "-s") == 0 || strcmp(cmd.argv[i], "-p") == 0)) {
+        prefijo = cmd.argv[i][1] == 'p';
+        if (i + 1 >= cmd.argc) {
+            fprintf(stderr, "history: %s necesita un texto\n", cmd.argv[i]);
+            return 2;
+        }
+        texto = cmd.argv[i + 1];
+        i += 2;
+    }
+    int maximo = i < cmd.argc ? atoi(cmd.argv[i]) : -1;
+    if (ruta == NULL) {
+        fprintf(stderr, "history: sin historial\n");
+        return 1;
+    }
+
+    // Se recogen de la mas reciente hacia atras y se imprimen al reves
+    int total = historial_total();
+    int* ids = malloc((total > 0 ? total : 1) * sizeof(int));
+    int n = 0;
+    for (int id = total; maximo < 0 || n < maximo;) {
+        id = texto ? historial_buscar(texto, id, prefijo) : id - 1;
+        if (id < 0) break;
+        if (!texto && !entradas[id].vivo) continue;
+        ids[n++] = id;
+    }
+    for (int k = n - 1; k >= 0; k--) {
+        size_t largo;
+        const char* linea_hist = historial_texto(ids[k], &largo);
+        printf("%6d  %.*s\n", ids[k] + 1, (int)largo, linea_hist);
+    }
+    free(ids);
+    return 0;
+}
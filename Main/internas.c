@@ -0,0 +1,396 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "parser.h"
+#include "myshell.h"
+
+// Comandos internos rapidos: echo, pwd, true, false, printf, test/[ y cat.
+// Se ejecutan dentro de la shell sin fork ni exec. Respetan las redirecciones
+// de la linea escribiendo directamente en los descriptores abiertos.
+// Con --externos (o MSH_EXTERNOS=1) se usan siempre los binarios del sistema.
+// Una opcion, conversion, escape o expresion que la version rapida no conoce
+// devuelve INTERNA_EXTERNA antes de escribir nada y se ejecuta el binario.
+
+int forzar_externos = 0;
+
+// Descriptores del comando: entrada, salida y error, ya redirigidos
+typedef struct {
+    int fd[3];
+    tRedirecciones redir;
+} tFdsInterna;
+
+// El mismo plan de redirecciones que para un hijo, sin los dup2
+static int abrir_fds(tline* linea, tFdsInterna* fds) {
+    if (abrir_redirecciones(linea, &fds->redir) < 0) {
+        return -1;
+    }
+    fds->fd[0] = fds->redir.entrada >= 0 ? fds->redir.entrada : STDIN_FILENO;
+    fds->fd[1] = fds->redir.salida >= 0 ? fds->redir.salida : STDOUT_FILENO;
+    fds->fd[2] = fds->redir.error >= 0 ? fds->redir.error : STDERR_FILENO;
+    if (linea->commands[0].merge_error) {
+        fds->fd[2] = fds->fd[1];
+    }
+    // Lo que la shell tenga en el buffer de stdout va antes que la salida del comando
+    fflush(stdout);
+    return 0;
+}
+
+static void cerrar_fds(tFdsInterna* fds) {
+    cerrar_redirecciones(&fds->redir);
+}
+
+static int escribir_todo(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// echo [-n] args...: -e, -E y --help/--version son para el binario
+
+static int interna_echo(tcommand* cmd, tFdsInterna* fds) {
+    int i = 1;
+    int salto = 1;
+    if (cmd->argc == 2 && (strcmp(cmd->argv[1], "--help") == 0 || strcmp(cmd->argv[1], "--version") == 0)) {
+        return INTERNA_EXTERNA;
+    }
+    // Como en GNU echo, las palabras iniciales de solo letras de opcion son opciones
+    for (; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1] != '\0'
+           && strspn(cmd->argv[i] + 1, "neE") == strlen(cmd->argv[i] + 1); i++) {
+        if (strspn(cmd->argv[i] + 1, "n") != strlen(cmd->argv[i] + 1)) {
+            return INTERNA_EXTERNA;
+        }
+        salto = 0;
+    }
+
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&buf, &len);
+    for (; i < cmd->argc; i++) {
+        fputs(cmd->argv[i], f);
+        if (i < cmd->argc - 1) fputc(' ', f);
+    }
+    if (salto) fputc('\n', f);
+    fclose(f);
+
+    int r = escribir_todo(fds->fd[1], buf, len);
+    free(buf);
+    return r < 0 ? 1 : 0;
+}
+
+static int interna_pwd(tcommand* cmd, tFdsInterna* fds) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        dprintf(fds->fd[2], "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    dprintf(fds->fd[1], "%s\n", cwd);
+    return 0;
+}
+
+static int interna_true(tcommand* cmd, tFdsInterna* fds) {
+    return 0;
+}
+
+static int interna_false(tcommand* cmd, tFdsInterna* fds) {
+    return 1;
+}
+
+// printf formato args...: %s %b %c %d %i %u %x %X %o %% y escapes \n \t \\ etc.
+// Como en POSIX, el formato se repite mientras queden argumentos. Octales,
+// \x, \c, %f y demas van al binario
+
+// -1 si el escape no es de los que se conocen
+static int escape(FILE* f, const char** p) {
+    char c = *++(*p);
+    switch (c) {
+        case 'n': fputc('\n', f); break;
+        case 't': fputc('\t', f); break;
+        case 'r': fputc('\r', f); break;
+        case 'a': fputc('\a', f); break;
+        case 'b': fputc('\b', f); break;
+        case 'f': fputc('\f', f); break;
+        case 'v': fputc('\v', f); break;
+        case '\\': fputc('\\', f); break;
+        default: return -1;
+    }
+    return 0;
+}
+
+static int interna_printf(tcommand* cmd, tFdsInterna* fds) {
+    if (cmd->argc < 2) {
+        dprintf(fds->fd[2], "printf: uso: printf formato [argumentos]\n");
+        return 2;
+    }
+    const char* formato = cmd->argv[1];
+    int arg = 2;
+    int error = 0;
+    int externa = 0;
+    if (formato[0] == '-' && formato[1] == '-') {
+        return INTERNA_EXTERNA; // --help, --version o -- formato
+    }
+
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* f = open_memstream(&buf, &len);
+
+    do {
+        int consumidos = 0;
+        for (const char* p = formato; *p && !externa; p++) {
+            if (*p == '\\') {
+                externa = escape(f, &p) < 0;
+                continue;
+            }
+            if (*p != '%') {
+                fputc(*p, f);
+                continue;
+            }
+            if (p[1] == '%') {
+                fputc('%', f);
+                p++;
+                continue;
+            }
+
+            // Copiar la especificacion (flags, ancho, precision) hasta la conversion
+            char espec[32];
+            int k = 0;
+            espec[k++] = *p++;
+            while (*p && strchr("-+ #0123456789.", *p) && k < 28) espec[k++] = *p++;
+            char conversion = *p;
+            if (conversion == '\0') {
+                p--;
+                break;
+            }
+            const char* valor = arg < cmd->argc ? cmd->argv[arg++] : NULL;
+            consumidos++;
+
+            if (conversion == 's' || conversion == 'b') {
+                espec[k++] = 's';
+                espec[k] = '\0';
+                if (conversion == 'b' && valor) {
+                    for (const char* q = valor; *q && !externa; q++) {
+                        if (*q == '\\') externa = escape(f, &q) < 0;
+                        else fputc(*q, f);
+                    }
+                } else {
+                    fprintf(f, espec, valor ? valor : "");
+                }
+            } else if (conversion == 'c') {
+                espec[k++] = 'c';
+                espec[k] = '\0';
+                fprintf(f, espec, valor ? valor[0] : '\0');
+            } else if (strchr("diuxXo", conversion)) {
+                // 'a vale el codigo del caracter: eso lo hace el binario
+                if (valor && (valor[0] == '\'' || valor[0] == '"')) {
+                    externa = 1;
+                    continue;
+                }
+                char* fin = NULL;
+                long long n = valor ? strtoll(valor, &fin, 0) : 0;
+                if (valor && *fin != '\0') {
+                    dprintf(fds->fd[2], "printf: %s: número inválido\n", valor);
+                    error = 1;
+                }
+                espec[k++] = 'l';
+                espec[k++] = 'l';
+                espec[k++] = conversion;
+                espec[k] = '\0';
+                fprintf(f, espec, n);
+            } else {
+                externa = 1;
+            }
+        }
+        if (consumidos == 0) break;
+    } while (arg < cmd->argc && !externa);
+
+    fclose(f);
+    if (externa) {
+        free(buf);
+        return INTERNA_EXTERNA;
+    }
+    escribir_todo(fds->fd[1], buf, len);
+    free(buf);
+    return error;
+}
+
+// test expr / [ expr ]: ! , -e -f -d -r -w -x -s -z -n, = != y comparaciones -eq ...
+// Lo demas (-L, -nt, -a, parentesis...) lo evalua el binario
+
+static int test_unario(const char* op, const char* valor) {
+    struct stat st;
+    if (strlen(op) != 2) return -1;
+    switch (op[1]) {
+        case 'z': return valor[0] == '\0';
+        case 'n': return valor[0] != '\0';
+        case 'e': return stat(valor, &st) == 0;
+        case 'f': return stat(valor, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(valor, &st) == 0 && S_ISDIR(st.st_mode);
+        case 's': return stat(valor, &st) == 0 && st.st_size > 0;
+        case 'r': return access(valor, R_OK) == 0;
+        case 'w': return access(valor, W_OK) == 0;
+        case 'x': return access(valor, X_OK) == 0;
+    }
+    return -1;
+}
+
+static int test_binario(const char* a, const char* op, const char* b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+
+    // Un entero mal escrito es un error que informa el binario
+    char *fin_a, *fin_b;
+    long long x = strtoll(a, &fin_a, 10);
+    long long y = strtoll(b, &fin_b, 10);
+    if (*a == '\0' || *fin_a != '\0' || *b == '\0' || *fin_b != '\0') return -1;
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    if (strcmp(op, "-ge") == 0) return x >= y;
+    return -1;
+}
+
+static int interna_test(tcommand* cmd, tFdsInterna* fds) {
+    int argc = cmd->argc;
+    char** argv = cmd->argv;
+
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            dprintf(fds->fd[2], "[: falta ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    int i = 1;
+    int negar = 0;
+    while (i < argc && strcmp(argv[i], "!") == 0 && argc - i > 1) {
+        negar = !negar;
+        i++;
+    }
+
+    int n = argc - i;
+    int r;
+    if (n == 0) r = 0;
+    else if (n == 1) r = argv[i][0] != '\0';
+    else if (n == 2 && argv[i][0] == '-') r = test_unario(argv[i], argv[i + 1]);
+    else if (n == 3) r = test_binario(argv[i], argv[i + 1], argv[i + 2]);
+    else r = -1;
+
+    if (r < 0) {
+        return INTERNA_EXTERNA;
+    }
+    return (r ^ negar) ? 0 : 1;
+}
+
+// cat: copia sin pasar por espacio de usuario cuando se puede.
+// copy_file_range entre ficheros, sendfile hacia cualquier descriptor y
+// read/write como ultimo recurso
+
+int copiar_fd(int entrada, int salida) {
+    char buf[64 * 1024];
+    ssize_t n;
+
+    while ((n = copy_file_range(entrada, NULL, salida, NULL, 1 << 30, 0)) > 0);
+    if (n == 0) {
+        return 0;
+    }
+    while ((n = sendfile(salida, entrada, NULL, 1 << 30)) > 0);
+    if (n == 0) {
+        return 0;
+    }
+    while ((n = read(entrada, buf, sizeof(buf))) > 0) {
+        if (escribir_todo(salida, buf, n) < 0) return -1;
+    }
+    return n < 0 ? -1 : 0;
+}
+
+// Solo se copia dentro de la shell desde ficheros regulares: terminan y no
+// bloquean. Un fifo, /dev/zero o el terminal van al binario, que si recibe
+// el Ctrl-C que la shell tiene bloqueado
+static int es_regular(int fd, const char* ruta) {
+    struct stat st;
+    int r = ruta ? stat(ruta, &st) : fstat(fd, &st);
+    return r == 0 && S_ISREG(st.st_mode);
+}
+
+static int interna_cat(tcommand* cmd, tFdsInterna* fds) {
+    int error = 0;
+
+    for (int i = 1; i < cmd->argc; i++) {
+        const char* a = cmd->argv[i];
+        int es_entrada = strcmp(a, "-") == 0;
+        if ((a[0] == '-' && !es_entrada) || !es_regular(fds->fd[0], es_entrada ? NULL : a)) {
+            return INTERNA_EXTERNA;
+        }
+    }
+    if (cmd->argc == 1 && !es_regular(fds->fd[0], NULL)) {
+        return INTERNA_EXTERNA;
+    }
+
+    if (cmd->argc == 1) {
+        if (copiar_fd(fds->fd[0], fds->fd[1]) < 0) {
+            dprintf(fds->fd[2], "cat: %s\n", strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+    for (int i = 1; i < cmd->argc; i++) {
+        if (strcmp(cmd->argv[i], "-") == 0) {
+            if (copiar_fd(fds->fd[0], fds->fd[1]) < 0) {
+                dprintf(fds->fd[2], "cat: -: %s\n", strerror(errno));
+                error = 1;
+            }
+            continue;
+        }
+        int fd = open(cmd->argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            dprintf(fds->fd[2], "cat: %s: %s\n", cmd->argv[i], strerror(errno));
+            error = 1;
+            continue;
+        }
+        if (copiar_fd(fd, fds->fd[1]) < 0) {
+            dprintf(fds->fd[2], "cat: %s: %s\n", cmd->argv[i], strerror(errno));
+            error = 1;
+        }
+        close(fd);
+    }
+    return error;
+}
+
+// Punto de entrada comun: abre redirecciones, ejecuta y cierra
+
+static int ejecutar_rapida(tline* linea, int (*funcion)(tcommand*, tFdsInterna*)) {
+    tFdsInterna fds;
+    int estado;
+
+    if (abrir_fds(linea, &fds) < 0) {
+        estado = 1;
+    } else {
+        estado = funcion(&linea->commands[0], &fds);
+    }
+    cerrar_fds(&fds);
+    return estado;
+}
+
+int manejador_echo(tline* linea) { return ejecutar_rapida(linea, interna_echo); }
+int manejador_pwd(tline* linea) { return ejecutar_rapida(linea, interna_pwd); }
+int manejador_true(tline* linea) { return ejecutar_rapida(linea, interna_true); }
+int manejador_false(tline* linea) { return ejecutar_rapida(linea, interna_false); }
+int manejador_printf(tline* linea) { return ejecutar_rapida(linea, interna_printf); }
+int manejador_test(tline* linea) { return ejecutar_rapida(linea, interna_test); }
+int manejador_cat(tline* linea) { return ejecutar_rapida(linea, interna_cat); }
@@ -0,0 +1,419 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "myshell.h"
+
+// Mapa entero -> entero con direccionamiento abierto y sondeo lineal. El
+// borrado desplaza hacia atras en vez de dejar marcas, asi el mapa no se
+// degrada con miles de altas y bajas. La clave 0 no es valida
+
+typedef struct {
+    int clave;   // 0 si la casilla esta libre
+    int valor;
+} tCasilla;
+
+typedef struct {
+    tCasilla* casillas;
+    int capacidad;
+    int usados;
+} tMapa;
+
+static unsigned hash_entero(int clave) {
+    return (unsigned)clave * 2654435761u;
+}
+
+static void mapa_insertar_en(tCasilla* casillas, int capacidad, int clave, int valor) {
+    unsigned i = hash_entero(clave) & (capacidad - 1);
+    while (casillas[i].clave != 0 && casillas[i].clave != clave) {
+        i = (i + 1) & (capacidad - 1);
+    }
+    casillas[i].clave = clave;
+    casillas[i].valor = valor;
+}
+
+static int mapa_poner(tMapa* m, int clave, int valor) {
+    if (2 * (m->usados + 1) > m->capacidad) {
+        int nueva = m->capacidad ? m->capacidad * 2 : 64;
+        tCasilla* casillas = calloc(nueva, sizeof(tCasilla));
+        if (!casillas) {
+            perror("calloc"); return -1;
+        }
+        for (int i = 0; i < m->capacidad; i++) {
+            if (m->casillas[i].clave) {
+                mapa_insertar_en(casillas, nueva, m->casillas[i].clave, m->casillas[i].valor);
+            }
+        }
+        free(m->casillas);
+        m->casillas = casillas;
+        m->capacidad = nueva;
+    }
+    mapa_insertar_en(m->casillas, m->capacidad, clave, valor);
+    m->usados++;
+    return 0;
+}
+
+static int mapa_buscar(const tMapa* m, int clave) {
+    if (m->capacidad == 0) {
+        return -1;
+    }
+    unsigned mascara = m->capacidad - 1;
+    unsigned i = hash_entero(clave) & mascara;
+    while (m->casillas[i].clave != clave) {
+        if (m->casillas[i].clave == 0) return -1;
+        i = (i + 1) & mascara;
+    }
+    return (int)i;
+}
+
+// Devuelve el valor asociado y borra la clave (-1 si no estaba)
+static int mapa_quitar(tMapa* m, int clave) {
+    int i = mapa_buscar(m, clave);
+    if (i < 0) {
+        return -1;
+    }
+    int valor = m->casillas[i].valor;
+    unsigned mascara = m->capacidad - 1;
+    m->usados--;
+
+    // Desplazamiento hacia atras de las entradas que sondearon a traves del hueco
+    unsigned hueco = i;
+    unsigned j = i;
+    while (1) {
+        j = (j + 1) & mascara;
+        if (m->casillas[j].clave == 0) break;
+        unsigned ideal = hash_entero(m->casillas[j].clave) & mascara;
+        if (((j - ideal) & mascara) >= ((j - hueco) & mascara)) {
+            m->casillas[hueco] = m->casillas[j];
+            hueco = j;
+        }
+    }
+    m->casillas[hueco].clave = 0;
+    return valor;
+}
+
+static void mapa_liberar(tMapa* m) {
+    free(m->casillas);
+    m->casillas = NULL;
+    m->capacidad = m->usados = 0;
+}
+
+//TAD jobs como slot map: los jobs viven en bloques de tamaño fijo que nunca se
+//mueven, asi un tJob* sigue siendo valido mientras el job exista. Los huecos se
+//reutilizan con una lista libre y cada casilla lleva una generacion para que un
+//handle antiguo no apunte a un job nuevo. Indices id -> casilla y pgid -> casilla
+//para buscar en O(1), y una lista doble en orden de id para recorrer
+
+#define JOBS_POR_BLOQUE 256
+
+typedef struct {
+    tJob job;
+    unsigned generacion;
+    int ocupada;
+    int anterior, siguiente;   // Lista en orden de id (casillas), o lista libre
+} tCasillaJob;
+
+static tCasillaJob** bloques = NULL;
+static int n_bloques = 0;
+static int libre = -1;           // Primera casilla libre
+static int primero = -1, ultimo = -1;
+
+static tMapa por_id = {0};
+static tMapa por_pgid = {0};
+static tMapa por_pid = {0};      // pid de cada proceso en segundo plano -> pgid
+
+int contador_Jobs = 0;
+int siguienteId = 1;
+
+static tCasillaJob* casilla_job(int indice) {
+    return &bloques[indice / JOBS_POR_BLOQUE][indice % JOBS_POR_BLOQUE];
+}
+
+static int nueva_casilla() {
+    if (libre < 0) {
+        tCasillaJob* bloque = calloc(JOBS_POR_BLOQUE, sizeof(tCasillaJob));
+        tCasillaJob** temp = realloc(bloques, (n_bloques + 1) * sizeof(tCasillaJob*));
+        if (!bloque || !temp) {
+            free(bloque);
+            perror("realloc"); return -1;
+        }
+        bloques = temp;
+        bloques[n_bloques] = bloque;
+        // Encadenar las casillas nuevas en la lista libre
+        for (int k = JOBS_POR_BLOQUE - 1; k >= 0; k--) {
+            bloque[k].siguiente = libre;
+            libre = n_bloques * JOBS_POR_BLOQUE + k;
+        }
+        n_bloques++;
+    }
+    int indice = libre;
+    libre = casilla_job(indice)->siguiente;
+    return indice;
+}
+
+// Funciones relacionadas con la gestion de jobs
+
+tJob* add_job(pid_t pgid, int id, const char *cmd, const pid_t* pids, int npids) {
+    int indice = nueva_casilla();
+    if (indice < 0) {
+        return NULL;
+    }
+    tCasillaJob* c = casilla_job(indice);
+    c->job.pgid = pgid;
+    c->job.id = id;
+    c->job.comando = strdup(cmd);
+    c->job.vivos = npids;
+    c->job.primer_plano = 0;
+    c->job.parado = 0;
+    c->job.inicio = tiempo_ahora();
+    memset(&c->job.uso, 0, sizeof(c->job.uso));
+    c->job.colocacion = NULL;
+    c->ocupada = 1;
+
+    // Los id son crecientes: añadir al final mantiene el orden de la lista
+    c->anterior = ultimo;
+    c->siguiente = -1;
+    if (ultimo >= 0) casilla_job(ultimo)->siguiente = indice;
+    else primero = indice;
+    ultimo = indice;
+
+    mapa_poner(&por_id, id, indice);
+    mapa_poner(&por_pgid, pgid, indice);
+    for (int i = 0; i < npids; i++) {
+        mapa_poner(&por_pid, pids[i], pgid);
+    }
+    contador_Jobs++;
+    return &c->job;
+}
+
+static void quitar_casilla(int indice) {
+    tCasillaJob* c = casilla_job(indice);
+
+    mapa_quitar(&por_id, c->job.id);
+    mapa_quitar(&por_pgid, c->job.pgid);
+    free(c->job.comando);
+    c->job.comando = NULL;
+    free(c->job.colocacion);
+    c->job.colocacion = NULL;
+
+    if (c->anterior >= 0) casilla_job(c->anterior)->siguiente = c->siguiente;
+    else primero = c->siguiente;
+    if (c->siguiente >= 0) casilla_job(c->siguiente)->anterior = c->anterior;
+    else ultimo = c->anterior;
+
+    c->ocupada = 0;
+    c->generacion++;   // Invalida los handles que apuntaban aqui
+    c->siguiente = libre;
+    libre = indice;
+    contador_Jobs--;
+}
+
+void removeJob(tJob* job) {
+    int indice = mapa_buscar(&por_id, job->id);
+    if (indice >= 0) {
+        quitar_casilla(por_id.casillas[indice].valor);
+    }
+}
+
+//Dado un pgid busca el job en el indice y lo borra
+
+void removeJobxPgid(pid_t pgid) {
+    int i = mapa_buscar(&por_pgid, pgid);
+    if (i >= 0) {
+        quitar_casilla(por_pgid.casillas[i].valor);
+    }
+}
+
+tJob* getJobxId(int id) {
+    int i = mapa_buscar(&por_id, id);
+    if (i < 0) {
+        return NULL;
+    }
+    return &casilla_job(por_id.casillas[i].valor)->job; //Puntero estable, no una copia, para modificar el job
+}
+
+tJob* getJobxPgid(pid_t pgid) {
+    int i = mapa_buscar(&por_pgid, pgid);
+    if (i < 0) {
+        return NULL;
+    }
+    return &casilla_job(por_pgid.casillas[i].valor)->job;
+}
+
+// Handles estables: casilla en los 32 bits bajos y generacion en los altos
+
+tJobHandle job_handle(const tJob* job) {
+    int i = mapa_buscar(&por_id, job->id);
+    if (i < 0) {
+        return 0;
+    }
+    int indice = por_id.casillas[i].valor;
+    return ((tJobHandle)casilla_job(indice)->generacion << 32) | (unsigned)(indice + 1);
+}
+
+tJob* job_desde_handle(tJobHandle h) {
+    int indice = (int)(h & 0xffffffffu) - 1;
+    if (indice < 0 || indice >= n_bloques * JOBS_POR_BLOQUE) {
+        return NULL;
+    }
+    tCasillaJob* c = casilla_job(indice);
+    if (!c->ocupada || c->generacion != (unsigned)(h >> 32)) {
+        return NULL;
+    }
+    return &c->job;
+}
+
+// Recorrido en orden de id
+
+tJob* primerJob() {
+    return primero >= 0 ? &casilla_job(primero)->job : NULL;
+}
+
+tJob* ultimoJob() {
+    return ultimo >= 0 ? &casilla_job(ultimo)->job : NULL;
+}
+
+tJob* siguienteJob(const tJob* job) {
+    int siguiente = ((const tCasillaJob*)job)->siguiente;
+    return siguiente >= 0 ? &casilla_job(siguiente)->job : NULL;
+}
+
+int getSiguienteId() {
+    return siguienteId++;
+}
+
+// Procesos del job que aun no se han recogido (como mucho maximo)
+int job_pids(const tJob* job, pid_t* pids, int maximo) {
+    int n = 0;
+    for (int i = 0; i < por_pid.capacidad && n < maximo; i++) {
+        if (por_pid.casillas[i].clave && por_pid.casillas[i].valor == job->pgid) {
+            pids[n++] = por_pid.casillas[i].clave;
+        }
+    }
+    return n;
+}
+
+void job_colocacion(tJob* job, const char* descripcion) {
+    free(job->colocacion);
+    job->colocacion = descripcion && descripcion[0] ? strdup(descripcion) : NULL;
+}
+
+// Devuelve el pgid del proceso y lo borra de la tabla (0 si no estaba)
+pid_t pid_olvidar(pid_t pid) {
+    int pgid = mapa_quitar(&por_pid, pid);
+    return pgid < 0 ? 0 : pgid;
+}
+
+void liberar_jobs() {
+    while (primero >= 0) {
+        quitar_casilla(primero);
+    }
+    //Libera los bloques y los indices cuando sale
+    for (int i = 0; i < n_bloques; i++) {
+        free(bloques[i]);
+    }
+    free(bloques);
+    bloques = NULL;
+    n_bloques = 0;
+    libre = -1;
+    mapa_liberar(&por_id);
+    mapa_liberar(&por_pgid);
+    mapa_liberar(&por_pid);
+}
+
+// Recogida de hijos dirigida por SIGCHLD. El manejador solo escribe un byte en
+// una self-pipe; la recogida real se hace fuera del manejador, entre prompts,
+// con un unico bucle waitpid(-1, WNOHANG) para todos los hijos
+
+static int senal_pipe[2] = {-1, -1};
+
+static void manejador_SIGCHLD(int sig) {
+    int errno_guardado = errno;
+    char c = 0;
+    write(senal_pipe[1], &c, 1); // Si la pipe esta llena ya hay aviso pendiente
+    errno = errno_guardado;
+}
+
+// Vacia la self-pipe. Devuelve 1 si habia llegado algun SIGCHLD
+int reaper_drenar() {
+    char basura[256];
+    int hubo = 0;
+
+    if (senal_pipe[0] < 0) {
+        return 0;
+    }
+    while (read(senal_pipe[0], basura, sizeof(basura)) > 0) {
+        hubo = 1;
+    }
+    return hubo;
+}
+
+void recoger_hijos() {
+    int estatus;
+    struct rusage uso;
+    pid_t pid;
+    while ((pid = wait4(-1, &estatus, WNOHANG, &uso)) > 0) {
+        traza_hijo_fin(pid);
+        job_proceso_terminado(pid, &uso);
+    }
+}
+
+void iniciar_reaper() {
+    if (pipe2(senal_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        perror("pipe2");
+        return;
+    }
+
+    struct sigaction saction;
+    saction.sa_handler = manejador_SIGCHLD;
+    sigemptyset(&saction.sa_mask);
+    saction.sa_flags = SA_RESTART; // Tambien avisa de paradas (Ctrl-Z en primer plano)
+    sigaction(SIGCHLD, &saction, NULL);
+}
+
+int reaper_fd() {
+    return senal_pipe[0];
+}
+
+// El bucle de eventos los usa para no romper la linea que se esta editando
+void (*antes_de_avisar)() = NULL;
+void (*despues_de_avisar)() = NULL;
+
+// Un hijo de un job en segundo plano ha terminado: su rusage se suma al job
+void job_proceso_terminado(pid_t pid, const struct rusage* uso) {
+    pid_t pgid = pid_olvidar(pid);
+    if (pgid == 0) {
+        return; // Primer plano o job ya eliminado por fg
+    }
+    tJob* job = getJobxPgid(pgid);
+    if (job == NULL) {
+        return;
+    }
+    if (uso) {
+        uso_sumar(&job->uso, uso);
+    }
+    if (--job->vivos <= 0) {
+        // Un job que fg esta esperando termina sin aviso
+        if (shell_interactiva && !job->primer_plano) {
+            char totales[128];
+            resumen_job(totales, sizeof(totales), job);
+            if (antes_de_avisar) antes_de_avisar();
+            printf("[%d]+  Done\t\t%s\t(%s)\n", job->id, job->comando, totales);
+            if (despues_de_avisar) despues_de_avisar();
+        }
+        removeJob(job);
+    }
+}
+
+void procesar_hijos_terminados() {
+    // Sin aviso pendiente no hay nada que recoger: ni una sola llamada a waitpid
+    if (reaper_drenar()) {
+        recoger_hijos();
+    }
+}
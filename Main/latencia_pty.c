@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pty.h>
+#include <libgen.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/wait.h>
+
+// msh_latencia: mide la latencia que nota quien usa la shell, manejando el
+// binario miniShell real a traves de un pseudo-terminal.
+//
+//   arranque   desde el exec hasta que aparece el primer prompt
+//   eco        desde que se pulsa Enter hasta que aparece la salida
+//   prompt     desde la salida del comando hasta el siguiente prompt
+//
+// Se informa de la distribucion de cada medida y se termina con 1 si el p99
+// de alguna supera su presupuesto (en ms, configurable).
+
+#define PROMPT "msh> "
+#define ESPERA_MAXIMA_MS 10000
+
+typedef struct {
+    const char* nombre;
+    double* v;
+    int n;
+    double presupuesto_ms;
+} tMedida;
+
+typedef struct {
+    int fd;
+    pid_t pid;
+    char* buf;
+    size_t usado, capacidad;
+    size_t visto;           // lo anterior ya se ha emparejado
+} tSesion;
+
+static double ahora_ms() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static int comparar_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentil(const double* v, int n, double p) {
+    return v[(int)(p / 100.0 * (n - 1) + 0.5)];
+}
+
+static int abrir_sesion(tSesion* s, const char* binario) {
+    struct winsize tam = {.ws_row = 24, .ws_col = 120};
+    memset(s, 0, sizeof(*s));
+    s->pid = forkpty(&s->fd, NULL, NULL, &tam);
+    if (s->pid < 0) {
+        perror("forkpty");
+        return -1;
+    }
+    if (s->pid == 0) {
+        setenv("TERM", "dumb", 1);
+        execl(binario, binario, (char*)NULL);
+        fprintf(stderr, "%s: %s\n", binario, strerror(errno));
+        _exit(127);
+    }
+    s->capacidad = 64 * 1024;
+    s->buf = malloc(s->capacidad);
+    return 0;
+}
+
+static void cerrar_sesion(tSesion* s) {
+    write(s->fd, "exit\n", 5);
+    for (int i = 0; i < 200 && waitpid(s->pid, NULL, WNOHANG) == 0; i++) {
+        usleep(10000);
+    }
+    if (waitpid(s->pid, NULL, WNOHANG) == 0) {
+        kill(s->pid, SIGKILL);
+        waitpid(s->pid, NULL, 0);
+    }
+    close(s->fd);
+    free(s->buf);
+}
+
+// Lee del terminal hasta que aparece patron despues de lo ya visto. Devuelve
+// el instante en que llego, o -1 si no llega a tiempo
+static double esperar(tSesion* s, const char* patron) {
+    size_t largo = strlen(patron);
+    double limite = ahora_ms() + ESPERA_MAXIMA_MS;
+
+    while (1) {
+        char* p = memmem(s->buf + s->visto, s->usado - s->visto, patron, largo);
+        if (p) {
+            s->visto = p - s->buf + largo;
+            return ahora_ms();
+        }
+        double queda = limite - ahora_ms();
+        if (queda <= 0) {
+            return -1;
+        }
+        struct pollfd pfd = {.fd = s->fd, .events = POLLIN};
+        if (poll(&pfd, 1, (int)queda) <= 0) {
+            continue;
+        }
+        if (s->usado + 4096 > s->capacidad) {
+            // Lo ya emparejado no se necesita
+            memmove(s->buf, s->buf + s->visto, s->usado - s->visto);
+            s->usado -= s->visto;
+            s->visto = 0;
+            if (s->usado + 4096 > s->capacidad) {
+                s->capacidad *= 2;
+                s->buf = realloc(s->buf, s->capacidad);
+            }
+        }
+        ssize_t n = read(s->fd, s->buf + s->usado, s->capacidad - s->usado);
+        if (n <= 0) {
+            return -1; // La shell ha terminado
+        }
+        s->usado += n;
+    }
+}
+
+static int informar(tMedida* m) {
+    if (m->n == 0) {
+        printf("%-9s sin muestras\n", m->nombre);
+        return 1;
+    }
+    qsort(m->v, m->n, sizeof(double), comparar_double);
+    double p99 = percentil(m->v, m->n, 99);
+    int excede = p99 > m->presupuesto_ms;
+    printf("%-9s n=%-5d min %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms  (presupuesto %g ms)%s\n",
+           m->nombre, m->n, m->v[0], percentil(m->v, m->n, 50), percentil(m->v, m->n, 90), p99,
+           m->v[m->n - 1], m->presupuesto_ms, excede ? "  EXCEDIDO" : "");
+    return excede;
+}
+
+static void uso(const char* programa) {
+    fprintf(stderr, "Uso: %s [-b miniShell] [-a arranques] [-n iteraciones] [-c comando]\n"
+                    "          [--max-arranque ms] [--max-eco ms] [--max-prompt ms]\n", programa);
+}
+
+int main(int argc, char* argv[]) {
+    char binario[PATH_MAX];
+    int arranques = 5;
+    int iteraciones = 200;
+    const char* comando = "echo";
+    tMedida arranque = {"arranque", NULL, 0, 2000};
+    tMedida eco = {"eco", NULL, 0, 20};
+    tMedida prompt = {"prompt", NULL, 0, 20};
+
+    // Por defecto, el miniShell que esta junto a este ejecutable
+    char propio[PATH_MAX];
+    ssize_t largo = readlink("/proc/self/exe", propio, sizeof(propio) - 1);
+    propio[largo > 0 ? largo : 0] = '\0';
+    snprintf(binario, sizeof(binario), "%s/miniShell", dirname(propio));
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            uso(argv[0]);
+            return 2;
+        }
+        if (strcmp(argv[i], "-b") == 0) {
+            snprintf(binario, sizeof(binario), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            arranques = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            iteraciones = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            comando = argv[++i];
+        } else if (strcmp(argv[i], "--max-arranque") == 0) {
+            arranque.presupuesto_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-eco") == 0) {
+            eco.presupuesto_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-prompt") == 0) {
+            prompt.presupuesto_ms = atof(argv[++i]);
+        } else {
+            uso(argv[0]);
+            return 2;
+        }
+    }
+    if (arranques < 1 || iteraciones < 1) {
+        uso(argv[0]);
+        return 2;
+    }
+
+    arranque.v = malloc(arranques * sizeof(double));
+    eco.v = malloc(iteraciones * sizeof(double));
+    prompt.v = malloc(iteraciones * sizeof(double));
+    printf("%s: %d arranques, %d iteraciones de '%s'\n", binario, arranques, iteraciones, comando);
+    fflush(stdout);
+
+    // Arranque: cada muestra es una shell nueva
+    for (int i = 0; i < arranques; i++) {
+        tSesion s;
+        double t0 = ahora_ms();
+        if (abrir_sesion(&s, binario) < 0) {
+            return 2;
+        }
+        double t = esperar(&s, PROMPT);
+        if (t < 0) {
+            fprintf(stderr, "arranque: no aparece el prompt\n");
+            cerrar_sesion(&s);
+            return 2;
+        }
+        arranque.v[arranque.n++] = t - t0;
+        cerrar_sesion(&s);
+    }
+
+    // Ida y vuelta: una sola shell. La marca de cada iteracion se busca al
+    // principio de una linea, para no confundirla con el eco de lo tecleado
+    tSesion s;
+    if (abrir_sesion(&s, binario) < 0 || esperar(&s, PROMPT) < 0) {
+        fprintf(stderr, "no aparece el prompt\n");
+        return 2;
+    }
+    for (int i = 0; i < iteraciones; i++) {
+        char linea[256], marca[64];
+        snprintf(marca, sizeof(marca), "\nmarca%d\r", i);
+        snprintf(linea, sizeof(linea), "%s marca%d", comando, i);
+
+        // Se teclea la linea y se espera a su eco antes de pulsar Enter
+        write(s.fd, linea, strlen(linea));
+        if (esperar(&s, linea) < 0) break;
+
+        double t0 = ahora_ms();
+        write(s.fd, "\n", 1);
+        double t1 = esperar(&s, marca);
+        if (t1 < 0) break;
+        double t2 = esperar(&s, PROMPT);
+        if (t2 < 0) break;
+        eco.v[eco.n++] = t1 - t0;
+        prompt.v[prompt.n++] = t2 - t1;
+    }
+    cerrar_sesion(&s);
+    if (eco.n < iteraciones) {
+        fprintf(stderr, "la shell dejo de responder en la iteracion %d\n", eco.n);
+    }
+
+    int fallos = informar(&arranque) + informar(&eco) + informar(&prompt);
+    return (fallos > 0 || eco.n < iteraciones) ? 1 : 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -8,23 +9,20 @@
 #include <readline/history.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <fcntl.h>
 #include "parser.h"
+#include "myshell.h"
 
 //resuelve warning de unresolved symbol
 extern int rl_catch_signals;
 
-//TAD jobs como array dinamico
+// 0 cuando se ejecuta un script o la entrada no es un terminal
+int shell_interactiva = 1;
 
-typedef struct {
-    int id;
-    pid_t pgid;
-    char* comando;
-} tJob;
-
-tJob* jobs_Array = NULL;
-int contador_Jobs = 0;
-int jobs_capacity = 0;
-int siguienteId = 1;
+// Estado de salida del ultimo comando interno
+int ultimo_estado = 0;
+static int medir_tiempo = 0; // la linea actual lleva el prefijo time
 
 //Creamos un diccionario para manejar los comandos internos
 
@@ -35,6 +33,7 @@ typedef int (*funcion_tLine)(tline* linea);
 typedef struct {
     char *nombre;
     funcion_tLine funcion;
+    int rapida;     // sustituye a un binario externo; se omite con --externos o en &
 } command_entry;
 
 // Declaraciones de las funciones internas para que el diccionario funcione
@@ -44,6 +43,10 @@ int manejador_exit(tline* linea);
 int manejador_umask(tline* linea);
 int manejador_jobs(tline* linea);
 int manejador_fg(tline* linea);
+int manejador_hash(tline* linea);
+int manejador_pipesize(tline* linea);
+
+void ejecutar_linea(tline* entrada);
 
 command_entry diccionariodeComandos[] = {
     {"cd", manejador_cd},
@@ -51,6 +54,22 @@ command_entry diccionariodeComandos[] = {
     {"umask", manejador_umask},
     {"jobs", manejador_jobs},
     {"fg", manejador_fg},
+    {"hash", manejador_hash},
+    {"pipesize", manejador_pipesize},
+    {"sched", manejador_sched},
+    {"history", manejador_history},
+    {"stats", manejador_stats},
+    {"trace", manejador_trace},
+    {"parallel", manejador_parallel},
+    {"run", manejador_run},
+    {"echo", manejador_echo, 1},
+    {"pwd", manejador_pwd, 1},
+    {"true", manejador_true, 1},
+    {"false", manejador_false, 1},
+    {"printf", manejador_printf, 1},
+    {"test", manejador_test, 1},
+    {"[", manejador_test, 1},
+    {"cat", manejador_cat, 1},
     {NULL, NULL}
 };
 
@@ -64,81 +83,18 @@ void manejador_CrtlC() {
 
     // Limpiar la línea actual
     rl_replace_line("", 0);
+    bucle_abandonar(0);     // Un bucle a medias se descarta
+    rl_set_prompt("msh> ");
     rl_on_new_line();   // Informar a readline que la línea terminó
     rl_redisplay();     // Reimprime prompt inmediatamente
 }
 
-// Funciones relacionadas con la gestion de jobs
-
-void add_job(pid_t pgid, int id, const char *cmd) {
-    if (contador_Jobs >= jobs_capacity) {
-        int new_capacity = (jobs_capacity == 0) ? 4 : jobs_capacity * 2;
-        tJob* temp = realloc(jobs_Array, new_capacity * sizeof(tJob));
-        if (!temp) {
-            perror("realloc"); return;
-        }
-        jobs_Array = temp;
-        jobs_capacity = new_capacity;
-    }
-    jobs_Array[contador_Jobs].pgid = pgid;
-    jobs_Array[contador_Jobs].id = id;
-    jobs_Array[contador_Jobs].comando = strdup(cmd);
-    contador_Jobs++;
-}
-
-//Libera el indice y desde el indice hasta el final retrae todo el array una posicion
-
-void removeJobxIndex(int index) {
-    if (index >= 0 && index < contador_Jobs) {
-        free(jobs_Array[index].comando);
-        for (int i = index; i < contador_Jobs - 1; i++) {
-            jobs_Array[i] = jobs_Array[i + 1];
-        }
-        contador_Jobs--;
-    }
-}
-
-//Dado un pgid recorre el array buscando el pdgid y cuando lo encuentra borra el job
-
-void removeJobxPgid(pid_t pgid) {
-    for (int i = 0; i < contador_Jobs; i++) {
-        if (jobs_Array[i].pgid == pgid) {
-            removeJobxIndex(i);
-            return;
-        }
-    }
-}
-
-tJob* getJobxId(int id) {
-
-    for (int i = 0; i < contador_Jobs; i++) {
-        if (jobs_Array[i].id == id) {
-            return &jobs_Array[i]; //Devuelve la direccion de memoria. Es un puntero a tJob no una copia, para modificar el array
-        }
-    }
-    return NULL;
-}
-
-int getSiguienteId() {
-    return siguienteId++;
-}
-
-void comprobarJobsTerminados() {
-
-    for (int i = 0; i < contador_Jobs; i++) {
-
-        //Status recibe su valor despues de waitpid
-
-        int estatus;
-
-        pid_t resultado = waitpid(-jobs_Array[i].pgid, &estatus, WNOHANG); // Espera sin bloqueo por cualquier proceso del grupo pgid
-
-        if (resultado > 0) {
-            printf("[%d]+  Done\t\t%s\n", jobs_Array[i].id, jobs_Array[i].comando);
-            removeJobxIndex(i);
-            i--; //Se resta 1 posicion por cada job eliminado
-        }
-    }
+// Pasa el terminal al grupo pgid (el de la shell para recuperarlo)
+static void dar_terminal(pid_t pgid) {
+    uint64_t inicio = stats_inicio();
+    tcsetpgrp(STDIN_FILENO, pgid);
+    stats_fin(ST_TCSETPGRP, inicio);
+    traza_instante("terminal", "pgid", pgid);
 }
 
 // Gestion de la interfaz de shell
@@ -170,29 +126,52 @@ void iniciar_Shell() {
 
 // Gestion de la entrada
 
-tline* input() {
-    char *str = readline("msh> ");
-
+tline* procesar_entrada(char* str) {
     if (str == NULL) {
-        if (errno == EINTR) {
-            errno = 0;
-            return NULL;      // vuelve al bucle principal y se reimprime
-        }
-
         // Ctrl+D
         printf("\nSaliendo...\n");
-        for(int i = 0; i < contador_Jobs; i++) free(jobs_Array[i].comando);
-        free(jobs_Array);
+        liberar_jobs();
+        historial_cerrar();
         exit(0);
     }
 
-    if (strlen(str) > 0) add_history(str);
+    if (strlen(str) > 0) {
+        add_history(str);
+        historial_anadir(str);
+    }
 
+    // Las lineas de un for o while se guardan hasta su done
+    if (bucle_linea(str)) {
+        free(str);
+        return NULL;
+    }
     tline *linea = tokenize(str);
     free(str);
     return linea;
 }
 
+tline* input() {
+    char *str = readline(bucle_pendiente() ? "> " : "msh> ");
+
+    if (str == NULL && errno == EINTR) {
+        errno = 0;
+        return NULL;      // vuelve al bucle principal y se reimprime
+    }
+    return procesar_entrada(str);
+}
+
+// Llamada por readline (modo callback) desde el bucle de eventos
+
+void linea_interactiva(char* str) {
+    tline* entrada = procesar_entrada(str);
+
+    // línea vacía o Ctrl+C
+    if (entrada) {
+        ejecutar_linea(entrada);
+    }
+    rl_set_prompt(bucle_pendiente() ? "> " : "msh> ");
+}
+
 // Manejadores de comandos internos
 
 int manejador_cd(tline* linea) {
@@ -211,6 +190,7 @@ int manejador_cd(tline* linea) {
         perror("cd");
         return 1;
     }
+    zygote_estado_cambiado();
 
     // Obtener directorio absoluto actual
     char cwd[1024];
@@ -226,12 +206,8 @@ int manejador_cd(tline* linea) {
 
 int manejador_exit(tline* linea) {
     printf("Saliendo de la miniShell...\n");
-    for(int i=0; i<contador_Jobs; i++) {
-        free(jobs_Array[i].comando);
-    }
-
-    //Libera el array de jobs cuando sale
-    free(jobs_Array);
+    liberar_jobs();
+    historial_cerrar();
     exit(0);
 }
 
@@ -258,6 +234,7 @@ int manejador_umask(tline* linea) {
 
         mode_t mascara_nueva = (mode_t)val;
         umask(mascara_nueva);
+        zygote_estado_cambiado();
         printf("%03o\n", mascara_nueva);
     }
     return 0;
@@ -266,10 +243,14 @@ int manejador_umask(tline* linea) {
 //Se declara linea aunque no se use para que no de fallo en el diccionario
 
 int manejador_jobs(tline* linea) {
+    // Que no aparezcan como Running jobs que ya han terminado
+    procesar_hijos_terminados();
 
-    //Recorre el array de jobs e imprime el id y el comando de cada job que esta corriendo
-    for (int i = 0; i < contador_Jobs; i++) {
-        printf("[%d]+ Running\t%s\n", jobs_Array[i].id, jobs_Array[i].comando);
+    //Recorre los jobs en orden de id e imprime el id y el comando de cada job que esta corriendo
+    for (tJob* job = primerJob(); job != NULL; job = siguienteJob(job)) {
+        printf("[%d]+ %s\t%s", job->id, job->parado ? "Stopped" : "Running", job->comando);
+        if (job->colocacion) printf("\t[%s]", job->colocacion);
+        printf("\n");
     }
     return 0;
 }
@@ -285,7 +266,7 @@ int manejador_fg(tline* linea) {
         id = atoi(cmd.argv[1]);
     } else {
         if (contador_Jobs > 0) {
-            id = jobs_Array[contador_Jobs - 1].id;
+            id = ultimoJob()->id;
         }
     }
 
@@ -304,18 +285,39 @@ int manejador_fg(tline* linea) {
     pid_t pgid = job->pgid;
 
     // Control de terminal
-    tcsetpgrp(STDIN_FILENO, pgid);
+    if (shell_interactiva) dar_terminal(pgid);
 
     // Continuar si estaba parado
     kill(-pgid, SIGCONT);
+    job->parado = 0;
+
+    // Con el bucle de eventos se espera a los pidfds del job sin dejar de
+    // atender al resto de jobs
+    if (eventos_activo()) {
+        int parado = esperar_job_primer_plano(job);
+        if (shell_interactiva) {
+            printf("\n");
+            dar_terminal(getpgrp());
+        }
+        if (parado) {
+            printf("[%d]+  Stopped\t\t%s\n", id, getJobxId(id)->comando);
+        }
+        return 0;
+    }
 
-    int estatus;
-    waitpid(-pgid, &estatus, WUNTRACED);
+    // Se espera a todos los procesos del grupo, no solo al primero que acabe
+    int estatus = 0;
+    pid_t pid;
+    while ((pid = waitpid(-pgid, &estatus, WUNTRACED)) > 0 && !WIFSTOPPED(estatus)) {
+        traza_hijo_fin(pid);
+        pid_olvidar(pid);
+    }
 
     // Añadir salto de línea tras Ctrl-C o finalización del job
-    printf("\n");
-
-    tcsetpgrp(STDIN_FILENO, getpgrp());
+    if (shell_interactiva) {
+        printf("\n");
+        dar_terminal(getpgrp());
+    }
 
     if (WIFEXITED(estatus) || WIFSIGNALED(estatus)) {
         removeJobxPgid(pgid);
@@ -323,201 +325,730 @@ int manejador_fg(tline* linea) {
     return 0;
 }
 
+// hash: lista la tabla de comandos, -r la vacia y con nombres los resuelve
+
+int manejador_hash(tline* linea) {
+    tcommand cmd = linea->commands[0];
+
+    if (cmd.argc == 1) {
+        return hash_listar();
+    }
+    if (strcmp(cmd.argv[1], "-r") == 0) {
+        hash_vaciar();
+        completado_invalidar();
+        return 0;
+    }
+
+    int error = 0;
+    for (int i = 1; i < cmd.argc; i++) {
+        if (hash_buscar(cmd.argv[i]) == NULL) {
+            fprintf(stderr, "hash: %s: no se encuentra\n", cmd.argv[i]);
+            error = 1;
+        }
+    }
+    return error;
+}
+
+// pipesize [N[K|M] | max | auto | 0]: tamaño de las pipes de las pipelines
+
+int manejador_pipesize(tline* linea) {
+    tcommand cmd = linea->commands[0];
+    char descripcion[64];
+
+    if (cmd.argc == 1) {
+        describir_tam_pipe(&tam_pipe, descripcion, sizeof(descripcion));
+        printf("%s\n", descripcion);
+        return 0;
+    }
+    if (cmd.argc > 2 || parsear_tam_pipe(cmd.argv[1], &tam_pipe) != 0) {
+        fprintf(stderr, "pipesize: uso: pipesize [N[K|M] | max | auto | 0]\n");
+        return 1;
+    }
+    return 0;
+}
+
+const char* nombre_interna(int i) {
+    return diccionariodeComandos[i].nombre;
+}
+
 // Manejador de las ejecuciones de funciones internas
 
-int manejador_internas(tline* linea) {
+command_entry* buscar_interna(tline* linea) {
     // Si hay pipes, no se ejecuta funciones internas
     if (linea->ncommands != 1) {
-        return 0;
+        return NULL;
     }
 
     // Verificamos filename y argv[0]
     char* nombre_Comando = linea->commands[0].argv[0]; // Siempre argv[0]
 
     if (!nombre_Comando) {
-        return 0;
+        return NULL;
     }
 
     for (int i = 0; diccionariodeComandos[i].nombre != NULL; i++) {
         if (strcmp(nombre_Comando, diccionariodeComandos[i].nombre) == 0) {
-            diccionariodeComandos[i].funcion(linea);
-            return 1; // Manejado
+            // Las rapidas en segundo plano o con --externos van al binario
+            if (diccionariodeComandos[i].rapida && (forzar_externos || linea->background)) {
+                return NULL;
+            }
+            return &diccionariodeComandos[i];
         }
     }
-    return 0; // No manejado (será externo)
+    return NULL; // No manejado (será externo)
+}
+
+int manejador_internas(tline* linea) {
+    uint64_t inicio = stats_inicio();
+    command_entry* interna = buscar_interna(linea);
+    if (interna == NULL) {
+        return 0;
+    }
+    int estado = interna->funcion(linea);
+    if (estado == INTERNA_EXTERNA) {
+        return 0; // La interna no puede con este caso: se ejecuta el binario
+    }
+    ultimo_estado = estado;
+    stats_fin(ST_INTERNA, inicio);
+    return 1; // Manejado
 }
 
 // Ejecucion
 
+// Añade texto a la descripcion de un job sin pasarse del buffer
+static void anadir_descripcion(char* buf, size_t tam, const char* texto) {
+    size_t usado = strlen(buf);
+    if (usado + 1 < tam) {
+        snprintf(buf + usado, tam - usado, "%s", texto);
+    }
+}
+
 void execArgs(tline* linea) {
     tcommand cmd = linea->commands[0];
     int bg = linea->background;
     int id = getSiguienteId(); // Reservamos un ID antes del fork para que padre e hijo lo conozcan
-    pid_t pid = fork();
+    double inicio = tiempo_ahora();
+
+    tRedirecciones redir;
+    if (abrir_redirecciones(linea, &redir) < 0) {
+        ultimo_estado = 1; // Sin crear el proceso
+        return;
+    }
+    colocar_linea(1);
+    tLanzamiento lanzamiento = {
+        .argv = cmd.argv, .pgid = 0,
+        .fd_entrada = redir.entrada, .fd_salida = redir.salida, .fd_error = redir.error,
+        .unir_error = cmd.merge_error, .primer_plano = !bg && shell_interactiva,
+        .colocacion = colocacion_etapa(0),
+    };
+    pid_t pid = lanzar_proceso(&lanzamiento);
+    cerrar_redirecciones(&redir);
+    if (pid < 0) {
+        ultimo_estado = 127;
+    }
+
+    if (pid > 0) { // Padre
+        // añade todos los argumentos
+        char job_cmd[1024] = "";
+        for (int i = 0; i < cmd.argc; i++) {
+            anadir_descripcion(job_cmd, sizeof(job_cmd), cmd.argv[i]);
+            if (i < cmd.argc - 1) anadir_descripcion(job_cmd, sizeof(job_cmd), " ");
+        }
+
+        if (!bg) {
+            if (shell_interactiva) dar_terminal(pid);
+            int vivos = 1;
+            pid_t pids[1] = {pid};
+            tResultado resultado[1];
+            int parado = esperar_primer_plano(pid, pids, &vivos, resultado);
+            if (shell_interactiva) {
+                dar_terminal(getpgrp());
+                printf("\n");
+            }
+            if (!parado) {
+                ultimo_estado = resultado[0].estado;
+                if (medir_tiempo) {
+                    informe_tiempos(tiempo_ahora() - inicio, resultado, 1, cmd.argv);
+                } else if (mostrar_resumen) {
+                    resumen_comando(tiempo_ahora() - inicio, resultado, 1);
+                }
+            } else {
+                // Ctrl-Z: el comando sigue como job parado
+                printf("[%d]+  Stopped\t\t%s\n", id, job_cmd);
+                tJob* job = add_job(pid, id, job_cmd, pids, vivos);
+                if (job) {
+                    job->parado = 1;
+                    job_colocacion(job, colocacion_aplicada());
+                }
+            }
+        } else {
+            printf("[%d] %d\t%s &\n", id, pid, job_cmd);
+            tJob* job = add_job(pid, id, job_cmd, &pid, 1);
+            if (job) job_colocacion(job, colocacion_aplicada());
+            eventos_vigilar_job(&pid, 1);
+        }
+    }
+}
 
-    if (pid == 0) { // Hijo
-        // Restaurar señales a default
-        signal(SIGINT, SIG_DFL); signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL); signal(SIGTTOU, SIG_DFL); signal(SIGTTIN, SIG_DFL);
+// Lanza todas las etapas de la linea conectadas por pipes y en un mismo grupo
+// (pgid 0: el de la primera etapa). Devuelve cuantas se lanzaron; pids y
+// nombres (si no es NULL) quedan en el orden de la pipeline.
+//
+// Cada pipe se crea justo antes de lanzar la etapa que escribe en ella y con
+// O_CLOEXEC: el hijo solo conserva los extremos que recibe con dup2 y no hay
+// que cerrar nada mas. En el padre como mucho hay abiertas la pipe de entrada
+// de la etapa y la de salida, asi que el coste es O(n) en llamadas al sistema
+// y en descriptores no depende de la longitud de la pipeline
+int lanzar_pipeline(tline* linea, pid_t pgid, pid_t* pids, char** nombres) {
+    return lanzar_pipeline_fds(linea, pgid, pids, nombres, NULL);
+}
 
-        setpgid(0, 0);
+// Igual, pero lo que no redirige la linea va a los descriptores de estandar
+// en vez de a los de la shell (--serve). No se cierran
+int lanzar_pipeline_fds(tline* linea, pid_t pgid, pid_t* pids, char** nombres,
+                        const tRedirecciones* estandar) {
+    int n = linea->ncommands;
+    int lanzados = 0;
+    // Solo un grupo nuevo en primer plano se queda con el terminal
+    int primer_plano = pgid == 0 && !linea->background && shell_interactiva;
 
-        // Comprobacion de redirecciones
+    tRedirecciones redir;
+    if (abrir_redirecciones(linea, &redir) < 0) {
+        return 0;
+    }
+    // Extremo de lectura de la pipe de la etapa anterior; la primera etapa
+    // recibe el fichero de entrada, que se cierra como una pipe mas
+    int entrada = redir.entrada;
+    redir.entrada = -1;
+    colocar_linea(n);
 
-        if (linea->redirect_input && !freopen(linea->redirect_input, "r", stdin)) {
-            fprintf(stderr, "%s: Error. %s\n", linea->redirect_input, strerror(errno));
-            exit(1);
+    for (int i = 0; i < n; i++) {
+        int salida[2] = {-1, -1};
+        if (i < n - 1 && pipe2(salida, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            break; // Las etapas ya lanzadas reciben EOF o SIGPIPE
         }
-        if (linea->redirect_output && !freopen(linea->redirect_output, "w", stdout)) {
-            fprintf(stderr, "%s: Error. %s\n", linea->redirect_output, strerror(errno));
-            exit(1);
+        if (salida[0] >= 0) {
+            configurar_tuberia(salida[0]);
+        }
+
+        // Gestionar redirecciones y flujo entre procesos
+        tLanzamiento lanzamiento = {
+            .argv = linea->commands[i].argv,
+            // Todos los procesos en la pipeline comparten el mismo PGID
+            .pgid = pgid,
+            .fd_entrada = entrada,
+            .fd_salida = (i == n-1) ? redir.salida : salida[1],
+            .fd_error = (i == n-1) ? redir.error : -1,
+            .unir_error = linea->commands[i].merge_error,
+            .primer_plano = primer_plano,
+            .colocacion = colocacion_etapa(i),
+        };
+        if (estandar) {
+            if (i == 0 && entrada < 0) lanzamiento.fd_entrada = estandar->entrada;
+            if (lanzamiento.fd_salida < 0) lanzamiento.fd_salida = estandar->salida;
+            if (lanzamiento.fd_error < 0) lanzamiento.fd_error = estandar->error;
         }
-        if (linea->redirect_error && !freopen(linea->redirect_error, "w", stderr)) {
-            fprintf(stderr, "%s: Error. %s\n", linea->redirect_error, strerror(errno));
-            exit(1);
+        pid_t pid = lanzar_proceso(&lanzamiento);
+        if (pid > 0 && i > 0 && entrada >= 0) {
+            vigilar_tuberia(pid, entrada);
         }
 
-        execvp(cmd.argv[0], cmd.argv);
-        // Usar stderr para que el error no se pierda en pipes
-        fprintf(stderr, "%s: no se encuentra\n", cmd.argv[0]);
-        exit(1);
-    }
-    if (pid > 0) { // Padre
-        setpgid(pid, pid);
-        if (!bg) {
-            tcsetpgrp(STDIN_FILENO, pid);
-            waitpid(pid, NULL, 0);
-            tcsetpgrp(STDIN_FILENO, getpgrp());
-            printf("\n");
-        } else {
-            // añade todos los argumentos
-            char job_cmd[1024] = "";
-            for (int i = 0; i < cmd.argc; i++) {
-                strcat(job_cmd, cmd.argv[i]);
-                if (i < cmd.argc - 1) strcat(job_cmd, " ");
-            }
+        // El hijo ya tiene sus copias: el padre solo se queda con la lectura
+        // de la nueva pipe, que sera la entrada de la siguiente etapa
+        if (entrada >= 0) close(entrada);
+        if (salida[1] >= 0) close(salida[1]);
+        entrada = salida[0];
 
-            printf("[%d] %d\t%s &\n", id, pid, job_cmd);
-            add_job(pid, id, job_cmd);
+        if (pid < 0) {
+            continue; // El resto de etapas reciben EOF o SIGPIPE al cerrar sus pipes
         }
-    } else {
-        perror("fork");
+        if (pgid == 0) {
+            pgid = pid;
+        }
+        if (nombres) nombres[lanzados] = linea->commands[i].argv[0];
+        pids[lanzados++] = pid;
     }
+    if (entrada >= 0) close(entrada);
+    cerrar_redirecciones(&redir);
+    return lanzados;
 }
 
 void execArgsPiped(tline* linea) {
     int n = linea->ncommands;
     int bg = linea->background;
     int id = getSiguienteId();
-    pid_t group_pid = 0;
-    int pipes[n - 1][2];
-    pid_t pids[n];
-
-    // Crear N-1 pipes para conectar cada comando con el siguiente
-    for (int i = 0; i < n - 1; i++) {
-        pipe(pipes[i]);
+    // En el heap: una pipeline puede tener miles de etapas
+    pid_t* pids = malloc(n * sizeof(pid_t));
+    char** nombres = malloc(n * sizeof(char*)); // argv[0] de cada etapa lanzada, para time
+    double inicio = tiempo_ahora();
+
+    // En modo adaptativo se vigilan las pipes de lo que se espera en primer plano
+    vigilar_tuberias = !bg;
+    int lanzados = lanzar_pipeline(linea, 0, pids, nombres);
+    vigilar_tuberias = 0;
+    if (lanzados == 0) {
+        ultimo_estado = 127;
+        soltar_tuberias();
+        free(pids);
+        free(nombres);
+        return;
     }
+    pid_t group_pid = pids[0];
 
+    char job_cmd[1024] = "";
     for (int i = 0; i < n; i++) {
-        pid_t pid = fork();
-        if (i == 0) {
-            group_pid = pid;
+        // filename es NULL si el comando no existe
+        anadir_descripcion(job_cmd, sizeof(job_cmd),
+                           linea->commands[i].filename ? linea->commands[i].filename : linea->commands[i].argv[0]);
+        if (i < n - 1) {
+            anadir_descripcion(job_cmd, sizeof(job_cmd), " | ");
         }
-        pids[i] = pid;
-        
-        if (pid == 0) {
-            // Todos los procesos en la pipeline comparten el mismo PGID
-            setpgid(0, group_pid); 
-            // Restaurar señales
-            signal(SIGINT, SIG_DFL); signal(SIGQUIT, SIG_DFL);
-            signal(SIGTSTP, SIG_DFL); signal(SIGTTOU, SIG_DFL); signal(SIGTTIN, SIG_DFL);
-
+    }
 
-            // Gestionar redirecciones y flujo entre procesos
-            if (i == 0 && linea->redirect_input && !freopen(linea->redirect_input, "r", stdin)) {
-                fprintf(stderr, "%s: Error. %s\n", linea->redirect_input, strerror(errno));
-                exit(1);
+    if (!bg) {
+        if (shell_interactiva) dar_terminal(group_pid);
+        // esperar_primer_plano deja en lanzados solo los que siguen vivos
+        int etapas = lanzados;
+        tResultado* resultados = malloc(etapas * sizeof(tResultado));
+        iniciar_muestreo_tuberias();
+        int parado = esperar_primer_plano(group_pid, pids, &lanzados, resultados);
+        soltar_tuberias();
+        if (shell_interactiva) {
+            dar_terminal(getpgrp());
+            printf("\n");
+        }
+        if (!parado) {
+            // El estado de la pipeline es el de su ultima etapa; si esa no
+            // llego a lanzarse, 127 como un comando que no existe
+            int ultima_lanzada = nombres[etapas - 1] == linea->commands[n - 1].argv[0];
+            ultimo_estado = ultima_lanzada ? resultados[etapas - 1].estado : 127;
+            if (medir_tiempo) {
+                informe_tiempos(tiempo_ahora() - inicio, resultados, etapas, nombres);
+            } else if (mostrar_resumen) {
+                resumen_comando(tiempo_ahora() - inicio, resultados, etapas);
             }
-            if (i > 0) {
-                //dup2 duplica un descriptor de archivo y lo ridirige al especificado
-                dup2(pipes[i-1][0], STDIN_FILENO);
+        } else {
+            printf("[%d]+  Stopped\t\t%s\n", id, job_cmd);
+            tJob* job = add_job(group_pid, id, job_cmd, pids, lanzados);
+            if (job) {
+                job->parado = 1;
+                job_colocacion(job, colocacion_aplicada());
             }
+        }
+        free(resultados);
+    } else {
+        printf("[%d] %d\t%s &\n", id, group_pid, job_cmd);
+        tJob* job = add_job(group_pid, id, job_cmd, pids, lanzados);
+        if (job) job_colocacion(job, colocacion_aplicada());
+        eventos_vigilar_job(pids, lanzados);
+    }
+    free(pids);
+    free(nombres);
+}
 
-            if (i == n-1) {
-                if (linea->redirect_output && !freopen(linea->redirect_output, "w", stdout)) {
-                    fprintf(stderr, "%s: Error. %s\n", linea->redirect_output, strerror(errno));
-                    exit(1);
-                }
-                if (linea->redirect_error && !freopen(linea->redirect_error, "w", stderr)) {
-                    fprintf(stderr, "%s: Error. %s\n", linea->redirect_error, strerror(errno));
-                    exit(1);
-                }
-            }else {
-                dup2(pipes[i][1], STDOUT_FILENO);
-            }
+// Ejecuta una linea ya tokenizada, venga de readline o de un script
 
-            // Cierre de pipes
-            for (int k = 0; k < n - 1; k++) {
-                close(pipes[k][0]); close(pipes[k][1]);
-            }
+// time cmd ...: se quita la palabra time y se mide el resto de la linea
+static int quitar_prefijo_time(tline* entrada) {
+    if (entrada->ncommands < 1) {
+        return 0;
+    }
+    tcommand* primero = &entrada->commands[0];
+    if (primero->argc < 2 || strcmp(primero->argv[0], "time") != 0) {
+        return 0;
+    }
+    primero->argv++;
+    primero->argc--;
+    primero->filename = NULL; // era la ruta de time
+    return 1;
+}
 
-            execvp(linea->commands[i].argv[0], linea->commands[i].argv);
-            perror("execvp"); exit(1);
+// MSH_PIPE_SZ=tam cmd | cmd ...: tamaño de las pipes solo para esta linea.
+// Devuelve 1 si habia prefijo; deja en anterior el ajuste de la shell
+static int quitar_prefijo_pipe(tline* entrada, tTamPipe* anterior) {
+    if (entrada->ncommands < 1) {
+        return 0;
+    }
+    tcommand* primero = &entrada->commands[0];
+    if (primero->argc < 2 || strncmp(primero->argv[0], "MSH_PIPE_SZ=", 12) != 0) {
+        return 0;
+    }
+    tTamPipe tam;
+    if (parsear_tam_pipe(primero->argv[0] + 12, &tam) != 0) {
+        fprintf(stderr, "%s: tamaño no valido\n", primero->argv[0]);
+        return 0;
+    }
+    *anterior = tam_pipe;
+    tam_pipe = tam;
+    primero->argv++;
+    primero->argc--;
+    primero->filename = NULL;
+    return 1;
+}
+
+// MSH_CPUS=, MSH_NICE=, MSH_SCHED= o MSH_IOPRIO= delante de la linea: ajuste
+// de sched solo para ella. La primera vez guarda en anterior el de la shell
+static int quitar_prefijo_colocacion(tline* entrada, tColocacion* anterior, int guardado) {
+    static const char* prefijos[][2] = {
+        {"MSH_CPUS=", "cpus"}, {"MSH_NICE=", "nice"}, {"MSH_SCHED=", "policy"}, {"MSH_IOPRIO=", "ioprio"},
+    };
+    if (entrada->ncommands < 1) {
+        return 0;
+    }
+    tcommand* primero = &entrada->commands[0];
+    if (primero->argc < 2 || strncmp(primero->argv[0], "MSH_", 4) != 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(prefijos) / sizeof(prefijos[0]); i++) {
+        size_t largo = strlen(prefijos[i][0]);
+        if (strncmp(primero->argv[0], prefijos[i][0], largo) != 0) {
+            continue;
+        }
+        tColocacion nueva = colocacion;
+        if (parsear_colocacion(prefijos[i][1], primero->argv[0] + largo, &nueva) != 0) {
+            fprintf(stderr, "%s: ajuste no valido\n", primero->argv[0]);
+            return 0;
+        }
+        if (!guardado) *anterior = colocacion;
+        colocacion = nueva;
+        primero->argv++;
+        primero->argc--;
+        primero->filename = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void ejecutar_linea(tline* entrada) {
+    uint64_t inicio_linea = traza_activa ? stats_reloj() : 0;
+    // Los directorios de PATH se revisan como mucho una vez por linea
+    hash_nueva_linea();
+    tTamPipe tam_shell;
+    tColocacion colocacion_shell;
+    int con_tam_pipe = 0, con_colocacion = 0;
+    // Los prefijos MSH_...= van delante de todo y en cualquier orden
+    while (1) {
+        if (!con_tam_pipe && quitar_prefijo_pipe(entrada, &tam_shell)) con_tam_pipe = 1;
+        else if (quitar_prefijo_colocacion(entrada, &colocacion_shell, con_colocacion)) con_colocacion = 1;
+        else break;
+    }
+    medir_tiempo = quitar_prefijo_time(entrada) && !entrada->background;
+
+    // Ejecutar comandos internos o externos. Una interna corre en la shell:
+    // time mide lo que gasta la shell y los hijos que recoja (run, parallel)
+    struct rusage propio, hijos;
+    if (medir_tiempo) {
+        getrusage(RUSAGE_SELF, &propio);
+        getrusage(RUSAGE_CHILDREN, &hijos);
+    }
+    double inicio = tiempo_ahora();
+    if (manejador_internas(entrada)) {
+        if (medir_tiempo) {
+            double real = tiempo_ahora() - inicio;
+            tResultado interna = {.estado = ultimo_estado};
+            struct rusage hijos_despues;
+            getrusage(RUSAGE_SELF, &interna.uso);
+            getrusage(RUSAGE_CHILDREN, &hijos_despues);
+            uso_restar(&interna.uso, &propio);
+            uso_restar(&hijos_despues, &hijos);
+            hijos_despues.ru_maxrss = 0; // el de todos los hijos de la shell, no el de estos
+            uso_sumar(&interna.uso, &hijos_despues);
+            informe_tiempos(real, &interna, 1, NULL);
         }
-        setpgid(pid, group_pid);
     }
+    else if (entrada->ncommands == 1) {
+        execArgs(entrada);
+    }
+    else if (entrada->ncommands >= 2) {
+        execArgsPiped(entrada);
+    }
+    if (con_tam_pipe) {
+        tam_pipe = tam_shell;
+    }
+    if (con_colocacion) {
+        colocacion = colocacion_shell;
+    }
+    if (shell_interactiva && entrada->ncommands >= 1) {
+        printf("\n"); // salto de línea entre comandos
+    }
+    if (inicio_linea && entrada->ncommands >= 1) {
+        traza_evento("linea", inicio_linea, stats_reloj(), entrada->commands[0].argv[0]);
+    }
+    stats_atender();
+}
+
+// Ultimo comando de -c: en vez de fork + wait, la propia shell hace exec.
+// En una pipeline se lanzan las etapas anteriores y la ultima sustituye a la
+// shell, leyendo de la ultima pipe. Solo vuelve si hay un error
+
+int exec_directo(tline* linea) {
+    int n = linea->ncommands;
+    tcommand ultimo = linea->commands[n - 1];
 
-    // Cierre de pipes
+    tRedirecciones redir;
+    if (abrir_redirecciones(linea, &redir) < 0) {
+        return 1;
+    }
+    // Extremo de lectura de la pipe de la etapa previa; al principio el
+    // fichero de entrada, si lo hay
+    int anterior = redir.entrada;
+    colocar_linea(n);
     for (int i = 0; i < n - 1; i++) {
-        close(pipes[i][0]); close(pipes[i][1]);
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) < 0) {
+            perror("pipe2");
+            // Las etapas ya lanzadas reciben EOF o SIGPIPE
+            if (anterior >= 0) close(anterior);
+            redir.entrada = -1; // era anterior o ya estaba cerrado
+            cerrar_redirecciones(&redir);
+            return 1;
+        }
+        tLanzamiento lanzamiento = {
+            .argv = linea->commands[i].argv,
+            // Sin control de trabajos: todas las etapas en el grupo de la shell
+            .pgid = getpgrp(),
+            .fd_entrada = anterior,
+            .fd_salida = p[1],
+            .fd_error = -1,
+            .unir_error = linea->commands[i].merge_error,
+            .colocacion = colocacion_etapa(i),
+        };
+        lanzar_proceso(&lanzamiento);
+        if (anterior >= 0) close(anterior);
+        close(p[1]);
+        anterior = p[0];
     }
 
-    if (!bg) {
-        tcsetpgrp(STDIN_FILENO, group_pid);
-        for (int i = 0; i < n; i++) {
-            waitpid(pids[i], NULL, 0);
+    // La ruta se busca despues de lanzar las demas etapas: lanzar_proceso
+    // tambien usa hash_buscar
+    const char* ruta = hash_buscar(ultimo.argv[0]);
+    if (ruta == NULL) {
+        fprintf(stderr, "%s: no se encuentra\n", ultimo.argv[0]);
+        if (anterior >= 0) close(anterior);
+        redir.entrada = -1;
+        cerrar_redirecciones(&redir);
+        return 127;
+    }
+
+    // La shell se convierte en la ultima etapa: el plan se aplica a ella misma
+    if (anterior >= 0) {
+        dup2(anterior, STDIN_FILENO);
+        close(anterior);
+    }
+    if (redir.salida >= 0) dup2(redir.salida, STDOUT_FILENO);
+    if (redir.error >= 0) dup2(redir.error, STDERR_FILENO);
+    if (ultimo.merge_error) dup2(STDOUT_FILENO, STDERR_FILENO);
+    redir.entrada = -1; // ya cerrado como anterior
+    cerrar_redirecciones(&redir);
+
+    const tColocacionEtapa* propia = colocacion_etapa(n - 1);
+    if (propia) aplicar_colocacion(propia);
+    fflush(stdout);
+    execv(ruta, ultimo.argv);
+    fprintf(stderr, "%s: Error. %s\n", ultimo.argv[0], strerror(errno));
+    return 126;
+}
+
+// -c "cadena": cada linea de la cadena se ejecuta en orden. Si la ultima es un
+// comando externo en primer plano se ejecuta con exec_directo
+
+int ejecutar_cadena(char* cadena) {
+    char* linea_str = cadena;
+
+    while (linea_str != NULL) {
+        char* siguiente = strchr(linea_str, '\n');
+        if (siguiente) *siguiente++ = '\0';
+        if (bucle_linea(linea_str)) {
+            linea_str = siguiente;
+            continue;
         }
-        tcsetpgrp(STDIN_FILENO, getpgrp());
-        printf("\n");
-    } else {
-        char job_cmd[1024] = "";
-        for (int i = 0; i < n; i++) {
-            strcat(job_cmd, linea->commands[i].filename);
-            if (i < n - 1) {
-                strcat(job_cmd, " | ");
+
+        tline* entrada = tokenize(linea_str);
+        if (entrada && entrada->ncommands >= 1) {
+            int es_ultima = (siguiente == NULL || *siguiente == '\0');
+            hash_nueva_linea();
+            // Con time hay que esperar al comando para medirlo: no se hace exec.
+            // Los prefijos MSH_...= solo los quita ejecutar_linea
+            int con_time = strcmp(entrada->commands[0].argv[0], "time") == 0;
+            int con_prefijo = strncmp(entrada->commands[0].argv[0], "MSH_", 4) == 0;
+            if (es_ultima && !entrada->background && !con_time && !con_prefijo) {
+                if (manejador_internas(entrada)) {
+                    return ultimo_estado;
+                }
+                return exec_directo(entrada);
             }
+            ejecutar_linea(entrada);
         }
-        printf("[%d] %d\t%s &\n", id, group_pid, job_cmd);
-        add_job(group_pid, id, job_cmd);
+        linea_str = siguiente;
     }
+    bucle_abandonar(1);
+    return ultimo_estado;
 }
 
-int main() {
-    // Inicialización shell
-    iniciar_Shell();
+// Modo no interactivo: sin banner, sin sleep y sin readline. Las lineas se
+// leen de un FILE con buffer grande y al final se informa del tiempo total
 
-    //tline* entrada;
+int ejecutar_script(FILE* fichero, const char* nombre) {
+    static char buffer[1 << 16];
+    setvbuf(fichero, buffer, _IOFBF, sizeof(buffer));
 
-    while (1) {
-        tline* entrada = input();
+    struct timespec inicio, fin;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
 
-        // línea vacía o Ctrl+C
-        if (!entrada) {
+    char* str = NULL;
+    size_t capacidad = 0;
+    long lineas = 0;
+
+    while (getline(&str, &capacidad, fichero) != -1) {
+        lineas++;
+
+        // Comentarios y lineas #! se saltan
+        char* p = str;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\0') {
             continue;
         }
 
-        // Ejecutar comandos internos o externos
-        if (manejador_internas(entrada)) {
+        procesar_hijos_terminados();
+
+        if (bucle_linea(str)) {
             continue;
         }
+        tline* entrada = tokenize(str);
+        if (!entrada) {
+            continue;
+        }
+        fflush(stdout); // Que la salida del script no se mezcle con la de los hijos
+        ejecutar_linea(entrada);
+    }
+    free(str);
+    bucle_abandonar(1);
+
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    double ms = (fin.tv_sec - inicio.tv_sec) * 1e3 + (fin.tv_nsec - inicio.tv_nsec) / 1e6;
+    fflush(stdout);
+    fprintf(stderr, "msh: %s: %ld lineas en %.3f ms\n", nombre, lineas, ms);
+    return ultimo_estado;
+}
 
-        if (entrada->ncommands == 1) {
-            execArgs(entrada);
-            printf("\n"); // salto de línea entre comandos
+// msh_bench enlaza este fichero para medir el despacho de internas y trae su
+// propio main
+#ifndef MSH_SIN_MAIN
+int main(int argc, char* argv[]) {
+    // Backend de lanzamiento: MSH_SPAWN o --spawn=fork|posix
+    char* spawn_env = getenv("MSH_SPAWN");
+    if (spawn_env && parsear_modo_spawn(spawn_env) != 0) {
+        fprintf(stderr, "MSH_SPAWN: modo desconocido: %s\n", spawn_env);
+    }
+    // Compatibilidad: usar siempre los binarios en vez de las internas rapidas
+    char* externos_env = getenv("MSH_EXTERNOS");
+    if (externos_env && strcmp(externos_env, "1") == 0) {
+        forzar_externos = 1;
+    }
+    // Linea de resumen de recursos tras cada comando en primer plano
+    char* resumen_env = getenv("MSH_RESUMEN");
+    if (resumen_env && strcmp(resumen_env, "1") == 0) {
+        mostrar_resumen = 1;
+    }
+    // Telemetria: MSH_STATS=1, MSH_STATS_JSON=ruta o --stats
+    stats_iniciar();
+    // Traza de eventos para chrome://tracing: MSH_TRACE=fichero o --trace=fichero
+    traza_iniciar();
+    // Tamaño de los buffers de las pipes entre etapas
+    char* pipe_env = getenv("MSH_PIPE_SZ");
+    if (pipe_env && parsear_tam_pipe(pipe_env, &tam_pipe) != 0) {
+        fprintf(stderr, "MSH_PIPE_SZ: tamaño no valido: %s\n", pipe_env);
+    }
+
+    char* script = NULL;
+    char* cadena = NULL;
+    char* socket_servidor = NULL;
+    int max_servidor = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cadena = argv[++i];
+        } else if (strcmp(argv[i], "--externos") == 0) {
+            forzar_externos = 1;
+        } else if (strcmp(argv[i], "--resumen") == 0) {
+            mostrar_resumen = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_activas = 1;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socket_servidor = argv[++i];
+        } else if (strncmp(argv[i], "--max=", 6) == 0) {
+            max_servidor = atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            if (traza_abrir(argv[i] + 8) != 0) {
+                return 2;
+            }
+        } else if (strncmp(argv[i], "--spawn=", 8) == 0) {
+            if (parsear_modo_spawn(argv[i] + 8) != 0) {
+                fprintf(stderr, "%s: modo desconocido (fork|posix|zygote)\n", argv[i]);
+                return 2;
+            }
+        } else if (argv[i][0] != '-' && script == NULL) {
+            script = argv[i];
+        } else {
+            fprintf(stderr, "Uso: %s [--spawn=fork|posix|zygote] [--externos] [--resumen] [--stats] [--trace=fichero] [-c cadena | script | --serve socket [--max=N]]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // El zygote se crea ahora, cuando la shell aun ocupa poca memoria
+    if (modo_spawn == SPAWN_ZYGOTE && zygote_iniciar() != 0) {
+        perror("zygote");
+    }
+
+    // miniShell --serve /ruta.sock: servidor de ejecucion para otros procesos
+    if (socket_servidor != NULL) {
+        shell_interactiva = 0;
+        return servir(socket_servidor, max_servidor);
+    }
+
+    // miniShell -c "cmd args | cmd2"
+    if (cadena != NULL) {
+        shell_interactiva = 0;
+        return ejecutar_cadena(cadena);
+    }
+
+    iniciar_reaper();
+
+    // miniShell script.msh o entrada por tuberia: modo por lotes
+    if (script != NULL || !isatty(STDIN_FILENO)) {
+        shell_interactiva = 0;
+        FILE* fichero = stdin;
+        if (script != NULL && (fichero = fopen(script, "re")) == NULL) {
+            fprintf(stderr, "%s: Error. %s\n", script, strerror(errno));
+            return 127;
         }
-        else if (entrada->ncommands >= 2) {
-            execArgsPiped(entrada);
-            printf("\n"); // salto de línea entre comandos
+        // Como sh: el estado de salida es el de la ultima orden
+        return ejecutar_script(fichero, script ? script : "stdin");
+    }
+
+    // Inicialización shell
+    iniciar_Shell();
+
+    // readline en modo callback dentro del bucle epoll: no vuelve. El
+    // historial se indexa desde el bucle mientras la shell esta ociosa
+    int con_eventos = eventos_iniciar() == 0;
+    historial_iniciar();
+    completado_iniciar();
+    if (con_eventos) {
+        eventos_bucle("msh> ", linea_interactiva);
+    }
+
+    while (1) {
+        // Avisos de jobs terminados justo antes del prompt
+        procesar_hijos_terminados();
+
+        tline* entrada = input();
+
+        // línea vacía o Ctrl+C
+        if (!entrada) {
+            continue;
         }
+        ejecutar_linea(entrada);
     }
-}
\ No newline at end of file
+}
+#endif
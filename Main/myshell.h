@@ -5,4 +5,301 @@
 #ifndef PRACTICAMINISHELL_MYSHELL_H
 #define PRACTICAMINISHELL_MYSHELL_H
 
-#endif //PRACTICAMINISHELL_MYSHELL_H
\ No newline at end of file
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "parser.h"
+
+// Lanzamiento de procesos (spawn.c)
+
+// Backend usado para crear los procesos hijos. Se elige al arrancar la shell
+typedef enum {
+    SPAWN_FORK,   // fork() + dup2 + execv en el hijo
+    SPAWN_POSIX,  // posix_spawn (clone con CLONE_VM|CLONE_VFORK en glibc)
+    SPAWN_ZYGOTE  // lo lanza un proceso auxiliar creado al arrancar (zygote.c)
+} tModoSpawn;
+
+extern tModoSpawn modo_spawn;
+
+// Todo lo que necesita saber un backend para lanzar una etapa
+typedef struct {
+    char** argv;
+    pid_t pgid;                  // 0 crea un grupo nuevo con el pid del hijo
+    // Los demas descriptores de la shell deben ser O_CLOEXEC: el hijo solo
+    // hereda estos tres (dup2 les quita el flag) y los estandar
+    int fd_entrada;              // -1 si hereda la entrada de la shell
+    int fd_salida;               // -1 si hereda la salida de la shell
+    int fd_error;                // -1 si hereda la salida de errores
+    int unir_error;              // 2>&1: stderr a donde acabe stdout
+    int primer_plano;            // el hijo se da el terminal antes del exec
+    const struct tColocacionEtapa* colocacion;  // NULL sin ajustes; el hijo los aplica antes del exec
+} tLanzamiento;
+
+// Redirecciones de una linea abiertas por la shell antes de lanzar nada: un
+// fichero que falta se detecta sin crear procesos y el hijo solo hace dup2.
+// La entrada es para la primera etapa y las salidas para la ultima
+typedef struct {
+    int entrada;                 // -1 si no se redirige
+    int salida;
+    int error;
+} tRedirecciones;
+
+pid_t lanzar_proceso(const tLanzamiento* l);
+int abrir_redirecciones(const tline* linea, tRedirecciones* r);  // -1 tras informar
+void cerrar_redirecciones(tRedirecciones* r);
+int parsear_modo_spawn(const char* nombre);
+const char* nombre_modo_spawn(tModoSpawn modo);
+void preparar_hijo(const tLanzamiento* l, const char* ruta, int terminal) __attribute__((noreturn));
+pid_t lanzar_posix(const tLanzamiento* l, const char* ruta);
+
+// Servidor de ejecucion por socket UNIX (servidor.c)
+
+int servir(const char* ruta, int maximo);   // miniShell --serve; maximo 0: 2 por CPU
+
+// Servidor de lanzamientos (zygote.c)
+
+int zygote_iniciar();               // -1 si no se pudo crear: se usa posix
+pid_t lanzar_zygote(const tLanzamiento* l, const char* ruta);
+void zygote_estado_cambiado();      // cd y umask: el zygote debe copiarlos
+
+// Ejecucion de lineas (myshell.c)
+
+// Pipeline completa en un grupo. Devuelve cuantas etapas se lanzaron
+int lanzar_pipeline(tline* linea, pid_t pgid, pid_t* pids, char** nombres);
+int lanzar_pipeline_fds(tline* linea, pid_t pgid, pid_t* pids, char** nombres,
+                        const tRedirecciones* estandar);
+void ejecutar_linea(tline* entrada);   // interna, pipeline o comando; deja ultimo_estado
+// 1 si la linea era un comando interno y ya se ha ejecutado
+int manejador_internas(tline* linea);
+const char* nombre_interna(int i);  // NULL detras de la ultima
+
+// Tabla hash de comandos (hash.c)
+
+const char* hash_buscar(const char* nombre);   // ruta o NULL si no existe; valida hasta hash_nueva_linea
+void hash_nueva_linea(void);
+void hash_vaciar(void);
+int hash_listar(void);
+
+// Jobs en segundo plano (jobs.c)
+
+typedef struct {
+    int id;
+    pid_t pgid;
+    char* comando;
+    int vivos;      // procesos del job que aun no se han recogido
+    int primer_plano; // fg lo esta esperando
+    int parado;       // detenido con Ctrl-Z
+    double inicio;    // tiempo_ahora() al lanzarlo
+    struct rusage uso; // suma de los rusage de sus procesos ya recogidos
+    char* colocacion;  // cpus, nice... aplicados al lanzarlo (NULL si ninguno)
+} tJob;
+
+// Handle estable de un job: deja de ser valido (NULL) cuando el job se elimina
+typedef unsigned long long tJobHandle;
+
+extern int contador_Jobs;
+extern int shell_interactiva;
+
+tJob* add_job(pid_t pgid, int id, const char *cmd, const pid_t* pids, int npids);
+void removeJob(tJob* job);
+void removeJobxPgid(pid_t pgid);
+tJob* getJobxId(int id);
+tJob* getJobxPgid(pid_t pgid);
+tJobHandle job_handle(const tJob* job);
+tJob* job_desde_handle(tJobHandle h);
+tJob* primerJob();
+tJob* ultimoJob();
+tJob* siguienteJob(const tJob* job);
+int getSiguienteId();
+void liberar_jobs();
+void resumen_job(char* buf, size_t tam, const tJob* job);
+int job_pids(const tJob* job, pid_t* pids, int maximo);
+void job_colocacion(tJob* job, const char* descripcion);
+
+void iniciar_reaper();
+int reaper_fd();
+int reaper_drenar();
+void recoger_hijos();
+void procesar_hijos_terminados();
+void job_proceso_terminado(pid_t pid, const struct rusage* uso);
+extern void (*antes_de_avisar)();
+extern void (*despues_de_avisar)();
+pid_t pid_olvidar(pid_t pid);
+
+// Traza de eventos en formato Chrome (traza.c)
+
+extern int traza_activa;
+int traza_abrir(const char* ruta);
+void traza_cerrar();
+void traza_iniciar();               // MSH_TRACE
+void traza_evento(const char* nombre, uint64_t inicio, uint64_t fin, const char* detalle);
+void traza_instante(const char* nombre, const char* clave, long valor);
+void traza_hijo(pid_t pid, const char* nombre);     // al lanzarlo
+void traza_hijo_fin(pid_t pid);                     // al recogerlo
+int manejador_trace(tline* linea);
+
+// Telemetria interna (estadisticas.c)
+
+typedef enum {
+    ST_TOKENIZE, ST_INTERNA, ST_LANZAR, ST_TCSETPGRP, ST_ESPERA, ST_PROMPT,
+    ST_TOTAL
+} tMetrica;
+
+extern int stats_activas;
+uint64_t stats_reloj();
+void stats_anotar(tMetrica m, uint64_t ns);
+void stats_medida(tMetrica m, uint64_t inicio);   // histograma y traza
+void stats_iniciar();               // MSH_STATS y MSH_STATS_JSON
+void stats_atender();               // volcado pedido con SIGUSR1
+void stats_json(FILE* f);
+int manejador_stats(tline* linea);
+
+// Punto de medida: inicio = stats_inicio(); ...; stats_fin(metrica, inicio).
+// Sin telemetria ni traza no se lee el reloj
+static inline uint64_t stats_inicio() {
+    return (stats_activas | traza_activa) ? stats_reloj() : 0;
+}
+
+static inline void stats_fin(tMetrica m, uint64_t inicio) {
+    if (inicio) stats_medida(m, inicio);
+}
+
+// Historial persistente (historial.c)
+
+int historial_abrir(const char* fichero);   // mmap; el indice se construye despues
+void historial_iniciar();                    // fichero por defecto, Ctrl-R e indexado ocioso
+void historial_anadir(const char* linea);
+int historial_indexar(int maximo);           // 1 si quedan lineas del fichero por indexar
+int historial_buscar(const char* texto, int antes, int prefijo);  // id o -1
+const char* historial_texto(int id, size_t* largo);
+int historial_total();
+void historial_cerrar();
+int manejador_history(tline* linea);
+
+// Completado de comandos (completado.c)
+
+void completado_iniciar();          // Tab en la primera palabra, inotify y lectura ociosa
+void completado_actualizar();       // lee ya los directorios pendientes
+void completado_invalidar();        // hash -r: volver a leer todo PATH
+int completado_buscar(const char* prefijo, int* primero);
+
+// Tamaño de los buffers de las pipes (tuberias.c)
+
+typedef enum { TP_DEFECTO, TP_FIJO, TP_AUTO } tModoPipe;
+
+typedef struct {
+    tModoPipe modo;
+    int bytes;          // solo con TP_FIJO
+} tTamPipe;
+
+extern tTamPipe tam_pipe;       // ajuste de la shell; MSH_PIPE_SZ=... lo cambia para una linea
+extern int vigilar_tuberias;    // la pipeline que se lanza se va a esperar en primer plano
+
+int tam_pipe_maximo();
+int parsear_tam_pipe(const char* texto, tTamPipe* tam);
+void describir_tam_pipe(const tTamPipe* tam, char* buf, size_t largo);
+void configurar_tuberia(int fd_lectura);
+void vigilar_tuberia(pid_t lector, int fd_lectura);
+int tuberias_vigiladas();
+void muestrear_tuberias();
+void soltar_tuberias();
+void iniciar_muestreo_tuberias();
+pid_t esperar_muestreando(pid_t pid, int* estatus, struct rusage* uso);
+
+// Colocacion de los procesos: CPUs, politica, nice y E/S (colocacion.c)
+
+typedef struct {
+    char cpus[128];     // "" sin fijar, "auto" o una lista por etapa separadas por ':'
+    int con_nice;
+    int nice;
+    int politica;       // -1 sin cambiar, SCHED_OTHER, SCHED_BATCH o SCHED_IDLE
+    int ioprio;         // -1 sin cambiar o el valor para ioprio_set
+} tColocacion;
+
+extern tColocacion colocacion;  // ajuste de la shell; MSH_CPUS=... y demas lo cambian para una linea
+
+int parsear_colocacion(const char* clave, const char* valor, tColocacion* c);  // -1 si no vale
+void describir_colocacion(const tColocacion* c, char* buf, size_t largo);
+
+// Ajustes de una etapa ya resueltos, sin depender del estado de la shell: el
+// zygote los recibe tal cual
+typedef struct tColocacionEtapa {
+    int con_cpus;
+    uint64_t cpus[16];  // cpu_set_t de CPU_SETSIZE bits
+    int politica;
+    int con_nice;
+    int nice;
+    int ioprio;
+} tColocacionEtapa;
+
+void colocar_linea(int etapas);             // antes de lanzar la linea (reparto de cpus=auto)
+const tColocacionEtapa* colocacion_etapa(int etapa);   // NULL sin ajustes; vale hasta la siguiente
+void aplicar_colocacion(const tColocacionEtapa* e);    // al propio proceso
+const char* colocacion_aplicada();          // para jobs: lo de la ultima linea o NULL
+int manejador_sched(tline* linea);
+
+// Contabilidad de recursos (tiempos.c)
+
+// Lo que queda de un proceso al recogerlo
+typedef struct {
+    int estado;           // codigo de salida, 128 + señal si lo mataron
+    struct rusage uso;
+} tResultado;
+
+extern int mostrar_resumen;
+
+double tiempo_ahora();
+int codigo_salida(int estatus);
+void uso_sumar(struct rusage* total, const struct rusage* uso);
+void uso_restar(struct rusage* uso, const struct rusage* antes);
+void informe_tiempos(double real, const tResultado* etapas, int n, char** nombres);
+void resumen_comando(double real, const tResultado* etapas, int n);
+void imprimir_uso(FILE* f, const struct rusage* uso);
+
+// Bucle de eventos interactivo (eventos.c)
+
+int eventos_iniciar();
+int eventos_activo();
+void eventos_bucle(const char* prompt, void (*manejador)(char* linea));
+void eventos_vigilar_job(const pid_t* pids, int n);
+int eventos_timer(int ms, void (*funcion)(void* datos), void* datos);
+int eventos_vigilar_fd(int fd, void (*funcion)(void* datos), void* datos);
+int esperar_primer_plano(pid_t pgid, pid_t* pids, int* n, tResultado* resultados);
+int esperar_job_primer_plano(tJob* job);
+
+void manejador_CrtlC();
+
+// Internas rapidas sin fork (internas.c)
+
+// Devuelto por una interna que no puede con el caso: se ejecuta el binario
+#define INTERNA_EXTERNA (-1)
+
+extern int forzar_externos;
+extern int ultimo_estado;
+
+int manejador_echo(tline* linea);
+int manejador_pwd(tline* linea);
+int manejador_true(tline* linea);
+int manejador_false(tline* linea);
+int manejador_printf(tline* linea);
+int manejador_test(tline* linea);
+int manejador_cat(tline* linea);
+int copiar_fd(int entrada, int salida);
+
+// parallel: un comando por entrada con trabajadores limitados (paralelo.c)
+
+int manejador_parallel(tline* linea);
+int cpus_disponibles();
+
+// Bucles for y while con el cuerpo tokenizado una vez (bucles.c)
+
+int bucle_linea(const char* str);   // 1 si la linea es de un bucle: ya se ha tratado
+int bucle_pendiente();              // hay un bucle sin done esperando lineas
+void bucle_abandonar(int avisar);   // descarta el bucle sin done
+
+// run: fichero de comandos con dependencias ejecutado como un DAG (dag.c)
+
+int manejador_run(tline* linea);
+
+#endif //PRACTICAMINISHELL_MYSHELL_H
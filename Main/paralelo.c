@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "parser.h"
+#include "myshell.h"
+
+// parallel [-j N] [-k] cmd args... [::: entrada...]
+//
+// Ejecuta cmd una vez por entrada con como mucho N procesos a la vez (por
+// defecto, las CPUs que puede usar la shell). Las entradas vienen tras ::: o,
+// si no hay, una por linea de la entrada estandar (o de la redireccion <).
+// Cada {} de los argumentos se sustituye por la entrada; si no hay ninguno la
+// entrada se añade como ultimo argumento.
+//
+// La salida de cada proceso se guarda en un memfd (o un fichero anonimo en
+// /tmp) y se vuelca entera cuando termina, asi no se mezclan lineas de
+// procesos distintos. Con -k se vuelca en el orden de las entradas en vez de
+// en el de terminacion. Los ajustes de sched se aplican a cada proceso.
+
+typedef struct {
+    char* entrada;
+    pid_t pid;
+    int salida;          // memfd con la salida del proceso, -1 si ya se volco
+    int terminado;
+    tResultado resultado;
+} tTarea;
+
+int cpus_disponibles() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// Sustituye {} por la entrada en una palabra de la plantilla
+static char* sustituir(const char* palabra, const char* entrada) {
+    size_t largo_entrada = strlen(entrada);
+    size_t largo = strlen(palabra) + 1;
+    for (const char* p = strstr(palabra, "{}"); p; p = strstr(p + 2, "{}")) {
+        largo += largo_entrada - 2;
+    }
+    char* resultado = malloc(largo);
+    char* destino = resultado;
+    const char* p;
+    while ((p = strstr(palabra, "{}")) != NULL) {
+        memcpy(destino, palabra, p - palabra);
+        destino += p - palabra;
+        memcpy(destino, entrada, largo_entrada);
+        destino += largo_entrada;
+        palabra = p + 2;
+    }
+    strcpy(destino, palabra);
+    return resultado;
+}
+
+// memfd para la salida de una tarea; sin memfd, un fichero anonimo en /tmp.
+// Nunca la salida de la shell: se mezclaria con la de las demas tareas
+static int abrir_salida() {
+    int fd = memfd_create("parallel", MFD_CLOEXEC);
+    if (fd < 0) {
+        fd = open(P_tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    }
+    return fd;
+}
+
+static pid_t lanzar_tarea(char** plantilla, int nplantilla, tTarea* t, int nulo) {
+    int con_llaves = 0;
+    for (int i = 0; i < nplantilla; i++) {
+        if (strstr(plantilla[i], "{}")) con_llaves = 1;
+    }
+
+    char* argv[nplantilla + 2];
+    int argc = 0;
+    for (int i = 0; i < nplantilla; i++) {
+        argv[argc++] = con_llaves ? sustituir(plantilla[i], t->entrada) : plantilla[i];
+    }
+    if (!con_llaves) {
+        argv[argc++] = t->entrada;
+    }
+    argv[argc] = NULL;
+
+    t->salida = abrir_salida();
+    if (t->salida < 0) {
+        fprintf(stderr, "parallel: %s: %s\n", t->entrada, strerror(errno));
+        t->pid = -1;
+    } else {
+        // Cada tarea es una linea de una etapa: con cpus=auto van rotando
+        colocar_linea(1);
+        tLanzamiento lanzamiento = {
+            .argv = argv,
+            // En el grupo de la shell: Ctrl-C llega a todos los procesos
+            .pgid = getpgrp(),
+            .fd_entrada = nulo,
+            .fd_salida = t->salida,
+            .fd_error = -1,
+            .colocacion = colocacion_etapa(0),
+        };
+        t->pid = lanzar_proceso(&lanzamiento);
+    }
+
+    if (con_llaves) {
+        for (int i = 0; i < nplantilla; i++) free(argv[i]);
+    }
+    return t->pid;
+}
+
+static void volcar(tTarea* t, int destino) {
+    if (t->salida < 0) {
+        return;
+    }
+    lseek(t->salida, 0, SEEK_SET);
+    copiar_fd(t->salida, destino);
+    close(t->salida);
+    t->salida = -1;
+}
+
+// Lee las entradas de f, una por linea
+static int leer_entradas(FILE* f, char*** entradas) {
+    int n = 0, capacidad = 0;
+    char* linea = NULL;
+    size_t tam = 0;
+    ssize_t largo;
+    while ((largo = getline(&linea, &tam, f)) != -1) {
+        if (largo > 0 && linea[largo - 1] == '\n') linea[--largo] = '\0';
+        if (largo == 0) continue;
+        if (n >= capacidad) {
+            capacidad = capacidad ? capacidad * 2 : 64;
+            *entradas = realloc(*entradas, capacidad * sizeof(char*));
+        }
+        (*entradas)[n++] = strdup(linea);
+    }
+    free(linea);
+    return n;
+}
+
+int manejador_parallel(tline* linea) {
+    tcommand cmd = linea->commands[0];
+    int trabajadores = cpus_disponibles();
+    int ordenado = 0;
+
+    int i = 1;
+    for (; i < cmd.argc && cmd.argv[i][0] == '-'; i++) {
+        if (strcmp(cmd.argv[i], "-k") == 0) {
+            ordenado = 1;
+        } else if (strcmp(cmd.argv[i], "-j") == 0 && i + 1 < cmd.argc) {
+            trabajadores = atoi(cmd.argv[++i]);
+        } else if (strncmp(cmd.argv[i], "-j", 2) == 0 && cmd.argv[i][2] != '\0') {
+            trabajadores = atoi(cmd.argv[i] + 2);
+        } else {
+            break;
+        }
+    }
+    if (trabajadores < 1) {
+        fprintf(stderr, "parallel: -j necesita un numero positivo\n");
+        return 2;
+    }
+
+    // Plantilla hasta ::: y entradas detras
+    char** plantilla = &cmd.argv[i];
+    int nplantilla = 0;
+    while (i + nplantilla < cmd.argc && strcmp(plantilla[nplantilla], ":::") != 0) {
+        nplantilla++;
+    }
+    if (nplantilla == 0) {
+        fprintf(stderr, "Uso: parallel [-j N] [-k] cmd [args] [::: entradas]\n");
+        return 2;
+    }
+
+    tRedirecciones redir;
+    if (abrir_redirecciones(linea, &redir) < 0) {
+        return 1;
+    }
+
+    char** entradas = NULL;
+    int nentradas = 0;
+    int propias = 0; // las entradas leidas se liberan al final
+    int separador = i + nplantilla;
+    if (separador < cmd.argc) {
+        entradas = &cmd.argv[separador + 1];
+        nentradas = cmd.argc - separador - 1;
+    } else {
+        FILE* f = stdin;
+        if (redir.entrada >= 0) {
+            f = fdopen(redir.entrada, "r");
+            redir.entrada = -1; // lo cierra fclose
+        }
+        nentradas = leer_entradas(f, &entradas);
+        if (f != stdin) fclose(f);
+        else clearerr(stdin);
+        propias = 1;
+    }
+
+    int destino = redir.salida >= 0 ? redir.salida : STDOUT_FILENO;
+    int nulo = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    fflush(stdout);
+
+    tTarea* tareas = calloc(nentradas > 0 ? nentradas : 1, sizeof(tTarea));
+    for (int k = 0; k < nentradas; k++) {
+        tareas[k].entrada = entradas[k];
+        tareas[k].salida = -1;
+    }
+
+    double inicio = tiempo_ahora();
+    struct rusage total;
+    memset(&total, 0, sizeof(total));
+    int siguiente = 0;     // proxima entrada a lanzar
+    int siguiente_volcar = 0;
+    int activos = 0;
+    int fallos = 0;
+    int interrumpido = 0;
+
+    while (siguiente < nentradas || activos > 0) {
+        while (!interrumpido && activos < trabajadores && siguiente < nentradas) {
+            tTarea* t = &tareas[siguiente++];
+            if (lanzar_tarea(plantilla, nplantilla, t, nulo) < 0) {
+                t->terminado = 1;
+                t->resultado.estado = 127;
+                fallos++;
+                continue;
+            }
+            activos++;
+        }
+        if (activos == 0) {
+            break;
+        }
+
+        // Se recoge cualquier hijo: los de jobs en segundo plano se pasan a
+        // su job como haria el reaper
+        int estatus;
+        struct rusage uso;
+        pid_t pid = wait4(-1, &estatus, 0, &uso);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        traza_hijo_fin(pid);
+        tTarea* t = NULL;
+        for (int k = siguiente_volcar; k < siguiente; k++) {
+            if (tareas[k].pid == pid && !tareas[k].terminado) { t = &tareas[k]; break; }
+        }
+        if (t == NULL) {
+            job_proceso_terminado(pid, &uso);
+            continue;
+        }
+
+        activos--;
+        t->terminado = 1;
+        t->resultado.estado = codigo_salida(estatus);
+        t->resultado.uso = uso;
+        uso_sumar(&total, &uso);
+        if (t->resultado.estado != 0) {
+            fallos++;
+        }
+        if (WIFSIGNALED(estatus) && WTERMSIG(estatus) == SIGINT) {
+            interrumpido = 1; // Ctrl-C: no se lanzan mas
+        }
+
+        if (!ordenado) {
+            volcar(t, destino);
+        }
+        while (siguiente_volcar < siguiente && tareas[siguiente_volcar].terminado) {
+            volcar(&tareas[siguiente_volcar++], destino);
+        }
+    }
+    for (int k = siguiente_volcar; k < siguiente; k++) {
+        volcar(&tareas[k], destino);
+    }
+
+    double real = tiempo_ahora() - inicio;
+    fprintf(stderr, "parallel: %d de %d entradas en %.3fs (%.1f/s, -j %d), %d fallos; ",
+            siguiente, nentradas, real, real > 0 ? siguiente / real : 0.0, trabajadores, fallos);
+    imprimir_uso(stderr, &total);
+    fprintf(stderr, "\n");
+
+    free(tareas);
+    if (propias) {
+        for (int k = 0; k < nentradas; k++) free(entradas[k]);
+        free(entradas);
+    }
+    if (nulo >= 0) close(nulo);
+    cerrar_redirecciones(&redir);
+    return (fallos > 0 || interrumpido) ? 1 : 0;
+}
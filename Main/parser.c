@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "parser.h"
+#include "myshell.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Tokenizador propio con la misma API que libparser.
+//
+// Toda la linea vive en una arena que se reinicia en la siguiente llamada a
+// tokenize(): la linea se copia una sola vez a la arena y se trocea en el
+// sitio, de modo que los argv apuntan dentro de esa copia. El tline devuelto
+// es valido hasta la siguiente llamada y no hay que liberarlo.
+
+#define BLOQUE_MINIMO (64 * 1024)
+#define RELLENO 16 // Bytes a cero tras la linea para poder leer de 16 en 16
+
+typedef struct tBloque {
+    struct tBloque* siguiente;
+    size_t capacidad;
+    size_t usado;
+    char datos[];
+} tBloque;
+
+static tBloque* arena = NULL;
+
+static void arena_reiniciar(void) {
+    if (arena == NULL) {
+        return;
+    }
+    // Si la linea anterior necesito varios bloques se funden en uno del tamaño
+    // total, asi en regimen estable solo hay un bloque
+    if (arena->siguiente != NULL) {
+        size_t total = 0;
+        while (arena) {
+            tBloque* b = arena;
+            total += b->capacidad;
+            arena = b->siguiente;
+            free(b);
+        }
+        arena = malloc(sizeof(tBloque) + total);
+        if (arena == NULL) {
+            return;
+        }
+        arena->siguiente = NULL;
+        arena->capacidad = total;
+    }
+    arena->usado = 0;
+}
+
+static void* arena_reservar(size_t n) {
+    n = (n + 15) & ~(size_t)15;
+    if (arena == NULL || arena->usado + n > arena->capacidad) {
+        size_t capacidad = n > BLOQUE_MINIMO ? n : BLOQUE_MINIMO;
+        tBloque* b = malloc(sizeof(tBloque) + capacidad);
+        if (b == NULL) {
+            return NULL;
+        }
+        b->siguiente = arena;
+        b->capacidad = capacidad;
+        b->usado = 0;
+        arena = b;
+    }
+    void* p = arena->datos + arena->usado;
+    arena->usado += n;
+    return p;
+}
+
+static char* arena_strdup(const char* s) {
+    size_t len = strlen(s) + 1;
+    char* copia = arena_reservar(len);
+    if (copia) memcpy(copia, s, len);
+    return copia;
+}
+
+// Busqueda de delimitadores: espacio, tabulador, saltos de linea, | < > & y el
+// fin de cadena. Con SSE2 se comparan 16 bytes a la vez
+
+static inline int es_delimitador(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r'
+        || c == '|' || c == '<' || c == '>' || c == '&' || c == '\0';
+}
+
+static char* buscar_delimitador(char* p) {
+#ifdef __SSE2__
+    const __m128i espacio = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i tuberia = _mm_set1_epi8('|');
+    const __m128i menor = _mm_set1_epi8('<');
+    const __m128i mayor = _mm_set1_epi8('>');
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i cero = _mm_setzero_si128();
+
+    // La copia de la linea lleva RELLENO bytes a cero: siempre se encuentra el
+    // '\0' antes de salir del buffer
+    while (1) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, espacio), _mm_cmpeq_epi8(v, tab)),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tuberia), _mm_cmpeq_epi8(v, menor)),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, mayor), _mm_cmpeq_epi8(v, amp))));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, cero));
+        int bits = _mm_movemask_epi8(m);
+        if (bits != 0) {
+            return p + __builtin_ctz(bits);
+        }
+        p += 16;
+    }
+#else
+    while (!es_delimitador(*p)) p++;
+    return p;
+#endif
+}
+
+// Tokens intermedios. El vector se reutiliza entre llamadas
+
+typedef enum {
+    T_PALABRA, T_TUBERIA, T_FONDO,
+    T_ENTRADA, T_ENTRADA_RW, T_SALIDA, T_ANADIR, T_ERROR,  // van seguidos de un fichero
+    T_UNIR_ERROR                                            // 2>&1
+} tTipoToken;
+
+static inline int lleva_fichero(tTipoToken tipo) {
+    return tipo >= T_ENTRADA && tipo <= T_ERROR;
+}
+
+typedef struct {
+    tTipoToken tipo;
+    char* texto;
+} tToken;
+
+static tToken* tokens = NULL;
+static int tokens_capacidad = 0;
+
+static int anadir_token(int n, tTipoToken tipo, char* texto) {
+    if (n >= tokens_capacidad) {
+        int nueva = tokens_capacidad ? tokens_capacidad * 2 : 64;
+        tToken* tmp = realloc(tokens, nueva * sizeof(tToken));
+        if (!tmp) return -1;
+        tokens = tmp;
+        tokens_capacidad = nueva;
+    }
+    tokens[n].tipo = tipo;
+    tokens[n].texto = texto;
+    return n + 1;
+}
+
+static tline* error_sintaxis(void) {
+    fprintf(stderr, "Error de sintaxis.\n");
+    return NULL;
+}
+
+static tline* trocear(char* str) {
+    arena_reiniciar();
+
+    size_t len = strlen(str);
+    char* buf = arena_reservar(len + RELLENO);
+    tline* linea = arena_reservar(sizeof(tline));
+    if (!buf || !linea) {
+        return NULL;
+    }
+    memcpy(buf, str, len);
+    memset(buf + len, 0, RELLENO);
+    memset(linea, 0, sizeof(tline));
+
+    // Primera pasada: trocear la copia en el sitio
+    int n = 0;
+    char* p = buf;
+    while (1) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') *p++ = '\0';
+        if (*p == '\0') break;
+
+        if (*p == '|') {
+            *p++ = '\0';
+            n = anadir_token(n, T_TUBERIA, NULL);
+        } else if (*p == '<' && p[1] == '>') {
+            *p++ = '\0'; *p++ = '\0';
+            n = anadir_token(n, T_ENTRADA_RW, NULL);
+        } else if (*p == '<') {
+            *p++ = '\0';
+            n = anadir_token(n, T_ENTRADA, NULL);
+        } else if (*p == '>' && p[1] == '&') {
+            *p++ = '\0'; *p++ = '\0';
+            n = anadir_token(n, T_ERROR, NULL);
+        } else if (*p == '>' && p[1] == '>') {
+            *p++ = '\0'; *p++ = '\0';
+            n = anadir_token(n, T_ANADIR, NULL);
+        } else if (*p == '2' && p[1] == '>' && p[2] == '&' && p[3] == '1' && es_delimitador(p[4])) {
+            memset(p, 0, 4);
+            p += 4;
+            n = anadir_token(n, T_UNIR_ERROR, NULL);
+        } else if (*p == '>') {
+            *p++ = '\0';
+            n = anadir_token(n, T_SALIDA, NULL);
+        } else if (*p == '&') {
+            *p++ = '\0';
+            n = anadir_token(n, T_FONDO, NULL);
+        } else {
+            char* fin = buscar_delimitador(p);
+            n = anadir_token(n, T_PALABRA, p);
+            p = fin;
+            continue; // El delimitador se trata (y se pone a '\0') en la siguiente vuelta
+        }
+        if (n < 0) return NULL;
+    }
+    if (n < 0) return NULL;
+
+    // Contar comandos y palabras por comando para reservar justo lo necesario
+    int ncomandos = 0;
+    int palabras = 0;
+    int hay_palabra = 0;
+    for (int i = 0; i < n; i++) {
+        if (tokens[i].tipo == T_PALABRA) {
+            if (i == 0 || !lleva_fichero(tokens[i-1].tipo)) {
+                palabras++;
+                if (!hay_palabra) ncomandos++;
+                hay_palabra = 1;
+            }
+        } else if (tokens[i].tipo == T_TUBERIA) {
+            if (!hay_palabra) return error_sintaxis();   // "| ls" o "ls | | wc"
+            hay_palabra = 0;
+        } else if (tokens[i].tipo == T_UNIR_ERROR) {
+            if (!hay_palabra) return error_sintaxis();  // "2>&1 ls": va detras del comando
+        } else if (tokens[i].tipo != T_FONDO) {
+            if (i + 1 >= n || tokens[i+1].tipo != T_PALABRA) return error_sintaxis();
+        }
+    }
+    if (n > 0 && ncomandos > 0 && !hay_palabra) {
+        return error_sintaxis(); // "ls |"
+    }
+
+    linea->ncommands = ncomandos;
+    linea->commands = arena_reservar(ncomandos * sizeof(tcommand));
+    char** argvs = arena_reservar((palabras + ncomandos) * sizeof(char*));
+    if ((ncomandos && !linea->commands) || !argvs) {
+        return NULL;
+    }
+
+    // Segunda pasada: rellenar comandos y redirecciones
+    int actual = 0;
+    int cmd_entrada = -1, cmd_salida = -1, cmd_error = -1;
+    tcommand* cmd = ncomandos ? &linea->commands[0] : NULL;
+    if (cmd) {
+        cmd->argc = 0;
+        cmd->argv = argvs;
+        cmd->merge_error = 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        switch (tokens[i].tipo) {
+            case T_PALABRA:
+                cmd->argv[cmd->argc++] = tokens[i].texto;
+                break;
+            case T_TUBERIA:
+                cmd->argv[cmd->argc] = NULL;
+                argvs += cmd->argc + 1;
+                cmd = &linea->commands[++actual];
+                cmd->argc = 0;
+                cmd->argv = argvs;
+                cmd->merge_error = 0;
+                break;
+            case T_ENTRADA:
+            case T_ENTRADA_RW:
+                if (linea->redirect_input) return error_sintaxis();
+                linea->inout_input = tokens[i].tipo == T_ENTRADA_RW;
+                linea->redirect_input = tokens[++i].texto;
+                cmd_entrada = actual;
+                break;
+            case T_SALIDA:
+            case T_ANADIR:
+                if (linea->redirect_output) return error_sintaxis();
+                linea->append_output = tokens[i].tipo == T_ANADIR;
+                linea->redirect_output = tokens[++i].texto;
+                cmd_salida = actual;
+                break;
+            case T_ERROR:
+                if (linea->redirect_error) return error_sintaxis();
+                linea->redirect_error = tokens[++i].texto;
+                cmd_error = actual;
+                break;
+            case T_UNIR_ERROR:
+                cmd->merge_error = 1;
+                break;
+            case T_FONDO:
+                linea->background = 1;
+                break;
+        }
+    }
+    if (cmd) {
+        cmd->argv[cmd->argc] = NULL;
+    }
+
+    // La entrada solo se puede redirigir en el primer comando y las salidas en el ultimo
+    if (ncomandos == 0 && (linea->redirect_input || linea->redirect_output || linea->redirect_error)) {
+        return error_sintaxis();
+    }
+    if ((cmd_entrada > 0) || (cmd_salida >= 0 && cmd_salida != ncomandos - 1)
+        || (cmd_error >= 0 && cmd_error != ncomandos - 1)) {
+        return error_sintaxis();
+    }
+    // ">& fichero" y "2>&1" en el mismo comando se contradicen
+    if (linea->redirect_error && linea->commands[ncomandos - 1].merge_error) {
+        return error_sintaxis();
+    }
+
+    // filename es la ruta completa del ejecutable (NULL si no esta en PATH)
+    for (int i = 0; i < ncomandos; i++) {
+        const char* ruta = hash_buscar(linea->commands[i].argv[0]);
+        linea->commands[i].filename = ruta ? arena_strdup(ruta) : NULL;
+    }
+    return linea;
+}
+
+tline* tokenize(char* str) {
+    if (!(stats_activas | traza_activa)) {
+        return trocear(str);
+    }
+    uint64_t inicio = stats_reloj();
+    tline* linea = trocear(str);
+    stats_medida(ST_TOKENIZE, inicio);
+    return linea;
+}
+
+// Arena aparte para tokenizar un fichero entero (run) sin pisar la linea que
+// lo ha pedido: apartar_arena() deja la actual a un lado y recuperar_arena()
+// libera la temporal y la vuelve a poner
+
+void* apartar_arena(void) {
+    tBloque* guardada = arena;
+    arena = NULL;
+    return guardada;
+}
+
+void recuperar_arena(void* guardada) {
+    while (arena) {
+        tBloque* b = arena;
+        arena = b->siguiente;
+        free(b);
+    }
+    arena = guardada;
+}
+
+// Copia independiente de la arena, para guardar una linea mas alla de la
+// siguiente llamada a tokenize(). Todo va en un unico bloque: se libera con
+// liberar_tline()
+
+static size_t largo_cadena(const char* s) {
+    return s ? strlen(s) + 1 : 0;
+}
+
+static char* copiar_cadena(char** destino, const char* s) {
+    if (s == NULL) {
+        return NULL;
+    }
+    size_t largo = strlen(s) + 1;
+    char* copia = memcpy(*destino, s, largo);
+    *destino += largo;
+    return copia;
+}
+
+tline* copiar_tline(const tline* linea) {
+    size_t punteros = 0;
+    size_t cadenas = largo_cadena(linea->redirect_input) + largo_cadena(linea->redirect_output)
+                   + largo_cadena(linea->redirect_error);
+    for (int i = 0; i < linea->ncommands; i++) {
+        const tcommand* cmd = &linea->commands[i];
+        punteros += cmd->argc + 1;
+        cadenas += largo_cadena(cmd->filename);
+        for (int j = 0; j < cmd->argc; j++) {
+            cadenas += largo_cadena(cmd->argv[j]);
+        }
+    }
+
+    size_t tam = sizeof(tline) + linea->ncommands * sizeof(tcommand)
+               + punteros * sizeof(char*) + cadenas;
+    tline* copia = malloc(tam);
+    if (copia == NULL) {
+        return NULL;
+    }
+    *copia = *linea;
+    copia->commands = (tcommand*)(copia + 1);
+    char** argvs = (char**)(copia->commands + linea->ncommands);
+    char* texto = (char*)(argvs + punteros);
+
+    copia->redirect_input = copiar_cadena(&texto, linea->redirect_input);
+    copia->redirect_output = copiar_cadena(&texto, linea->redirect_output);
+    copia->redirect_error = copiar_cadena(&texto, linea->redirect_error);
+    for (int i = 0; i < linea->ncommands; i++) {
+        const tcommand* cmd = &linea->commands[i];
+        tcommand* destino = &copia->commands[i];
+        destino->argc = cmd->argc;
+        destino->merge_error = cmd->merge_error;
+        destino->argv = argvs;
+        destino->filename = copiar_cadena(&texto, cmd->filename);
+        for (int j = 0; j < cmd->argc; j++) {
+            argvs[j] = copiar_cadena(&texto, cmd->argv[j]);
+        }
+        argvs[cmd->argc] = NULL;
+        argvs += cmd->argc + 1;
+    }
+    return copia;
+}
+
+void liberar_tline(tline* linea) {
+    free(linea);
+}
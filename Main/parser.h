@@ -4,6 +4,7 @@ typedef struct {
 	char * filename;
 	int argc;
 	char ** argv;
+	int merge_error;	/* 2>&1: stderr va a donde vaya stdout */
 } tcommand;
 
 typedef struct {
@@ -13,7 +14,13 @@ typedef struct {
 	char * redirect_output;
 	char * redirect_error;
 	int background;
+	int append_output;	/* >> en vez de > */
+	int inout_input;	/* <> en vez de <: lectura y escritura */
 } tline;
 
 extern tline * tokenize(char *str);
+extern void * apartar_arena(void);
+extern void recuperar_arena(void *guardada);
 
+extern tline * copiar_tline(const tline *linea);
+extern void liberar_tline(tline *linea);
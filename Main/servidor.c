@@ -0,0 +1,477 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "parser.h"
+#include "myshell.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+// miniShell --serve ruta.sock [--max=N]
+//
+// Servidor local de ejecucion: cada cliente que se conecta al socket UNIX
+// manda lineas de comandos y recibe, segun van terminando, su estado, su
+// rusage y opcionalmente su salida. Cada linea pasa por tokenize y por
+// lanzar_pipeline, con sus pipes y redirecciones, como en la shell; no hay
+// internas (cd o exit no tendrian sentido compartidos entre clientes). Lo
+// que la linea no redirige lee de /dev/null y escribe en un memfd (si se pide
+// la salida) o en /dev/null.
+//
+// Un unico epoll atiende el socket de escucha, los clientes, un pidfd por
+// cada proceso y SIGINT/SIGTERM. Como mucho corren max lineas a la vez; el
+// resto espera en una cola FIFO, y un cliente con demasiadas lineas
+// pendientes o con demasiada salida sin recoger deja de leerse hasta que
+// terminen algunas o las recoja.
+//
+// Protocolo (texto, campos separados por tabuladores):
+//   peticion:  id \t opciones \t linea \n      opciones: "-" u "o" (salida)
+//   respuesta: id \t estado \t real_us \t user_us \t sys_us \t maxrss_kib \t bytes \n
+//              seguida de bytes de salida
+// Una linea mal formada o vacia responde con estado 2; un comando que no se
+// encuentra, con 127.
+
+#define PENDIENTES_POR_CLIENTE 1024
+#define SALIDA_POR_CLIENTE (4 << 20) // bytes sin enviar a partir de los que no se lee
+#define LEIDOS_POR_VUELTA 65536
+
+typedef enum { S_ESCUCHA, S_CLIENTE, S_PROCESO, S_SENALES } tTipoServidor;
+
+typedef struct {
+    tTipoServidor tipo;
+    int fd;
+} tFuenteServidor;
+
+typedef struct tCliente tCliente;
+
+struct tCliente {
+    tFuenteServidor fuente;
+    char* entrada;              // bytes recibidos sin linea completa aun
+    size_t nentrada, capacidad_entrada;
+    char* salida;               // respuestas por enviar
+    size_t nsalida, enviados, capacidad_salida;
+    int pendientes;             // lineas en cola o en marcha
+    int leyendo;                // EPOLLIN activo
+    int escribiendo;            // EPOLLOUT activo
+    int fin_entrada;            // ya no manda mas lineas, pero espera respuestas
+    int roto;                   // se ha ido: sus respuestas se descartan
+    int liberado;               // pendiente de free al final de la vuelta
+    tCliente* siguiente_liberar;
+};
+
+typedef struct tTrabajoServidor tTrabajoServidor;
+
+typedef struct {
+    tFuenteServidor fuente;     // el pidfd
+    tTrabajoServidor* trabajo;
+    int ultima;                 // etapa cuyo estado es el de la linea
+} tProceso;
+
+struct tTrabajoServidor {
+    tCliente* cliente;
+    char* id;
+    char* texto;
+    int captura;
+    int memfd;
+    tProceso* procesos;
+    int vivos;
+    int estado;
+    struct rusage uso;
+    double inicio;
+    tTrabajoServidor* siguiente; // cola
+};
+
+static int epoll_fd = -1;
+static int max_trabajos = 0;
+static int activos = 0;
+static int nulo = -1;
+static tTrabajoServidor* cola = NULL;
+static tTrabajoServidor* ultimo_cola = NULL;
+static tCliente* por_liberar = NULL;
+
+// Un cliente que no recoge su salida no se lee ni lanza mas lineas: las que
+// ya mando se quedan en la cola, en orden, hasta que la recoja
+static int salida_llena(tCliente* c) {
+    return c->nsalida - c->enviados >= SALIDA_POR_CLIENTE;
+}
+
+static void armar_cliente(tCliente* c) {
+    int leer = !c->fin_entrada && !c->roto && c->pendientes < PENDIENTES_POR_CLIENTE
+               && !salida_llena(c);
+    int escribir = c->enviados < c->nsalida;
+    if (leer == c->leyendo && escribir == c->escribiendo) {
+        return;
+    }
+    struct epoll_event ev = {
+        .events = (leer ? EPOLLIN : 0) | (escribir ? EPOLLOUT : 0),
+        .data.ptr = &c->fuente,
+    };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fuente.fd, &ev);
+    c->leyendo = leer;
+    c->escribiendo = escribir;
+}
+
+// Un cliente que ya no manda nada se cierra cuando no le queda nada en marcha
+// ni por enviar. La memoria se libera al final de la vuelta: puede haber mas
+// eventos suyos en el mismo lote
+static int cliente_terminado(tCliente* c) {
+    if ((c->fin_entrada || c->roto) && c->pendientes == 0 && c->enviados >= c->nsalida) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fuente.fd, NULL);
+        close(c->fuente.fd);
+        c->liberado = 1;
+        c->siguiente_liberar = por_liberar;
+        por_liberar = c;
+        return 1;
+    }
+    return 0;
+}
+
+static void liberar_clientes() {
+    while (por_liberar) {
+        tCliente* c = por_liberar;
+        por_liberar = c->siguiente_liberar;
+        free(c->entrada);
+        free(c->salida);
+        free(c);
+    }
+}
+
+static void enviar_pendiente(tCliente* c) {
+    while (c->enviados < c->nsalida) {
+        ssize_t n = send(c->fuente.fd, c->salida + c->enviados, c->nsalida - c->enviados,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN) {
+                c->roto = 1; // El cliente se ha ido: se descarta lo que quede
+                c->enviados = c->nsalida;
+            }
+            break;
+        }
+        c->enviados += n;
+    }
+    if (c->enviados >= c->nsalida) {
+        c->enviados = c->nsalida = 0;
+    }
+}
+
+static char* reservar_salida(tCliente* c, size_t bytes) {
+    // Lo ya enviado se descarta antes de crecer
+    if (c->nsalida + bytes > c->capacidad_salida && c->enviados > 0) {
+        c->nsalida -= c->enviados;
+        memmove(c->salida, c->salida + c->enviados, c->nsalida);
+        c->enviados = 0;
+    }
+    if (c->nsalida + bytes > c->capacidad_salida) {
+        while (c->nsalida + bytes > c->capacidad_salida) {
+            c->capacidad_salida = c->capacidad_salida ? c->capacidad_salida * 2 : 4096;
+        }
+        c->salida = realloc(c->salida, c->capacidad_salida);
+    }
+    char* p = c->salida + c->nsalida;
+    c->nsalida += bytes;
+    return p;
+}
+
+static long microsegundos(struct timeval t) {
+    return t.tv_sec * 1000000L + t.tv_usec;
+}
+
+static void responder(tTrabajoServidor* t) {
+    tCliente* c = t->cliente;
+    c->pendientes--;
+    if (!c->roto) {
+        off_t bytes = 0;
+        if (t->memfd >= 0) {
+            struct stat st;
+            if (fstat(t->memfd, &st) == 0) bytes = st.st_size;
+        }
+        char cabecera[512];
+        int n = snprintf(cabecera, sizeof(cabecera), "%s\t%d\t%ld\t%ld\t%ld\t%ld\t%lld\n",
+                         t->id, t->estado, (long)((tiempo_ahora() - t->inicio) * 1e6),
+                         microsegundos(t->uso.ru_utime), microsegundos(t->uso.ru_stime),
+                         t->uso.ru_maxrss, (long long)bytes);
+        memcpy(reservar_salida(c, n), cabecera, n);
+        if (bytes > 0) {
+            char* destino = reservar_salida(c, bytes);
+            ssize_t leidos = pread(t->memfd, destino, bytes, 0);
+            if (leidos < bytes) {
+                // No deberia pasar: se rellena para no romper el protocolo
+                memset(destino + (leidos > 0 ? leidos : 0), 0, bytes - (leidos > 0 ? leidos : 0));
+            }
+        }
+        enviar_pendiente(c);
+    }
+    if (!cliente_terminado(c)) {
+        armar_cliente(c);
+    }
+}
+
+static void liberar_trabajo(tTrabajoServidor* t) {
+    if (t->memfd >= 0) close(t->memfd);
+    free(t->procesos);
+    free(t->id);
+    free(t->texto);
+    free(t);
+}
+
+// Lanza la linea; si no queda ningun proceso en marcha responde ya
+static void lanzar_trabajo(tTrabajoServidor* t) {
+    t->inicio = tiempo_ahora();
+    tline* linea = tokenize(t->texto);
+    if (linea == NULL || linea->ncommands == 0) {
+        t->estado = 2;
+        responder(t);
+        liberar_trabajo(t);
+        return;
+    }
+    int n = linea->ncommands;
+    t->memfd = t->captura ? memfd_create("serve", MFD_CLOEXEC) : -1;
+    int salida = t->memfd >= 0 ? t->memfd : nulo;
+    tRedirecciones estandar = {nulo, salida, salida};
+
+    pid_t* pids = malloc(n * sizeof(pid_t));
+    char** nombres = malloc(n * sizeof(char*));
+    int lanzados = lanzar_pipeline_fds(linea, 0, pids, nombres, &estandar);
+    // El estado de la linea es el de la ultima etapa, si llego a lanzarse
+    int ultima_lanzada = lanzados > 0 && nombres[lanzados - 1] == linea->commands[n - 1].argv[0];
+    t->estado = ultima_lanzada ? 0 : 127;
+
+    t->procesos = calloc(lanzados > 0 ? lanzados : 1, sizeof(tProceso));
+    for (int i = 0; i < lanzados; i++) {
+        tProceso* p = &t->procesos[i];
+        p->trabajo = t;
+        p->ultima = ultima_lanzada && i == lanzados - 1;
+        p->fuente.tipo = S_PROCESO;
+        p->fuente.fd = (int)syscall(SYS_pidfd_open, pids[i], 0);
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &p->fuente};
+        if (p->fuente.fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p->fuente.fd, &ev) < 0) {
+            // Sin pidfd se espera aqui mismo: solo pasa en kernels sin pidfd_open
+            int estatus;
+            struct rusage uso;
+            if (p->fuente.fd >= 0) close(p->fuente.fd);
+            p->fuente.fd = -1;
+            wait4(pids[i], &estatus, 0, &uso);
+            traza_hijo_fin(pids[i]);
+            uso_sumar(&t->uso, &uso);
+            if (p->ultima) t->estado = codigo_salida(estatus);
+            continue;
+        }
+        t->vivos++;
+    }
+    free(pids);
+    free(nombres);
+    activos++;
+    if (t->vivos == 0) {
+        activos--;
+        responder(t);
+        liberar_trabajo(t);
+    }
+}
+
+static void despachar() {
+    tTrabajoServidor** anterior = &cola;
+    tTrabajoServidor* ultimo_visto = NULL;
+    while (*anterior && activos < max_trabajos) {
+        tTrabajoServidor* t = *anterior;
+        if (!t->cliente->roto && salida_llena(t->cliente)) {
+            ultimo_visto = t;
+            anterior = &t->siguiente;
+            continue;
+        }
+        *anterior = t->siguiente;
+        if (*anterior == NULL) ultimo_cola = ultimo_visto;
+        if (t->cliente->roto) {
+            responder(t); // No se lanza lo que ya nadie va a recoger
+            liberar_trabajo(t);
+            continue;
+        }
+        lanzar_trabajo(t);
+    }
+}
+
+static void proceso_terminado(tProceso* p) {
+    siginfo_t info;
+    struct rusage uso;
+    memset(&info, 0, sizeof(info));
+    memset(&uso, 0, sizeof(uso));
+    syscall(SYS_waitid, P_PIDFD, p->fuente.fd, &info, WEXITED, &uso);
+    traza_hijo_fin(info.si_pid);
+    // Antes del close: un hijo recien lanzado puede tener aun una copia del
+    // pidfd (hasta su exec) y epoll seguiria avisando por el
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, p->fuente.fd, NULL);
+    close(p->fuente.fd);
+    p->fuente.fd = -1;
+
+    tTrabajoServidor* t = p->trabajo;
+    uso_sumar(&t->uso, &uso);
+    if (p->ultima) {
+        t->estado = (info.si_code == CLD_EXITED) ? info.si_status : 128 + info.si_status;
+    }
+    if (--t->vivos == 0) {
+        activos--;
+        responder(t);
+        liberar_trabajo(t);
+    }
+}
+
+// Una linea del protocolo: id \t opciones \t comando
+static void peticion(tCliente* c, char* linea) {
+    tTrabajoServidor* t = calloc(1, sizeof(tTrabajoServidor));
+    t->cliente = c;
+    t->memfd = -1;
+    c->pendientes++;
+
+    char* opciones = strchr(linea, '\t');
+    char* texto = opciones ? strchr(opciones + 1, '\t') : NULL;
+    if (texto == NULL) {
+        t->id = strdup(opciones ? "?" : linea);
+        t->estado = 2;
+        responder(t);
+        liberar_trabajo(t);
+        return;
+    }
+    *opciones++ = '\0';
+    *texto++ = '\0';
+    t->id = strdup(linea);
+    t->captura = strchr(opciones, 'o') != NULL;
+    t->texto = strdup(texto);
+
+    if (ultimo_cola) ultimo_cola->siguiente = t;
+    else cola = t;
+    ultimo_cola = t;
+}
+
+static void leer_cliente(tCliente* c) {
+    if (c->capacidad_entrada - c->nentrada < LEIDOS_POR_VUELTA) {
+        c->capacidad_entrada = c->nentrada + LEIDOS_POR_VUELTA;
+        c->entrada = realloc(c->entrada, c->capacidad_entrada);
+    }
+    ssize_t n = read(c->fuente.fd, c->entrada + c->nentrada, LEIDOS_POR_VUELTA);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        // Fin de la entrada: lo que ya mando se sigue ejecutando y respondiendo
+        if (n == 0) c->fin_entrada = 1;
+        else c->roto = 1;
+        if (!cliente_terminado(c)) armar_cliente(c);
+        return;
+    }
+    c->nentrada += n;
+
+    char* inicio = c->entrada;
+    char* fin = c->entrada + c->nentrada;
+    char* salto;
+    // Si al responder a una linea mal formada resulta que se ha ido, se para
+    while (!c->roto && (salto = memchr(inicio, '\n', fin - inicio)) != NULL) {
+        *salto = '\0';
+        peticion(c, inicio);
+        inicio = salto + 1;
+    }
+    c->nentrada = fin - inicio;
+    memmove(c->entrada, inicio, c->nentrada);
+    armar_cliente(c);
+}
+
+static void aceptar(int escucha) {
+    int fd;
+    while ((fd = accept4(escucha, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        tCliente* c = calloc(1, sizeof(tCliente));
+        c->fuente.tipo = S_CLIENTE;
+        c->fuente.fd = fd;
+        c->leyendo = 1;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &c->fuente};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+int servir(const char* ruta, int maximo) {
+    max_trabajos = maximo > 0 ? maximo : 2 * (int)sysconf(_SC_NPROCESSORS_ONLN);
+    nulo = open("/dev/null", O_RDWR | O_CLOEXEC);
+
+    struct sockaddr_un dir = {.sun_family = AF_UNIX};
+    if (strlen(ruta) >= sizeof(dir.sun_path)) {
+        fprintf(stderr, "%s: ruta demasiado larga\n", ruta);
+        return 2;
+    }
+    strcpy(dir.sun_path, ruta);
+    int escucha = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(ruta); // Un socket que quedo de una ejecucion anterior
+    if (escucha < 0 || bind(escucha, (struct sockaddr*)&dir, sizeof(dir)) < 0
+        || listen(escucha, SOMAXCONN) < 0) {
+        fprintf(stderr, "%s: Error. %s\n", ruta, strerror(errno));
+        return 1;
+    }
+
+    // SIGINT y SIGTERM terminan el servidor limpiamente, desde el bucle
+    sigset_t senales;
+    sigemptyset(&senales);
+    sigaddset(&senales, SIGINT);
+    sigaddset(&senales, SIGTERM);
+    sigprocmask(SIG_BLOCK, &senales, NULL);
+    tFuenteServidor fuente_senales = {S_SENALES, signalfd(-1, &senales, SFD_CLOEXEC)};
+    tFuenteServidor fuente_escucha = {S_ESCUCHA, escucha};
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &fuente_escucha};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, escucha, &ev);
+    ev.data.ptr = &fuente_senales;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fuente_senales.fd, &ev);
+    fprintf(stderr, "msh: sirviendo en %s (max %d lineas a la vez)\n", ruta, max_trabajos);
+
+    while (1) {
+        struct epoll_event eventos[256];
+        int n = epoll_wait(epoll_fd, eventos, 256, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        // Los directorios de PATH se revisan como mucho una vez por vuelta
+        hash_nueva_linea();
+        for (int i = 0; i < n; i++) {
+            tFuenteServidor* f = eventos[i].data.ptr;
+            if (f->tipo == S_SENALES) {
+                unlink(ruta);
+                return 0;
+            } else if (f->tipo == S_ESCUCHA) {
+                aceptar(f->fd);
+            } else if (f->tipo == S_PROCESO) {
+                proceso_terminado((tProceso*)f);
+            } else {
+                tCliente* c = (tCliente*)f;
+                if (c->liberado) continue;
+                // Primero lo que se pueda enviar: libera memoria y puede
+                // volver a permitir leer
+                if (eventos[i].events & EPOLLOUT) {
+                    enviar_pendiente(c);
+                    if (cliente_terminado(c)) continue;
+                    armar_cliente(c);
+                }
+                // armar_cliente puede haber dejado de leer en esta misma vuelta
+                if ((eventos[i].events & (EPOLLHUP | EPOLLERR))
+                    || ((eventos[i].events & EPOLLIN) && c->leyendo)) {
+                    leer_cliente(c);
+                }
+            }
+        }
+        despachar();
+        liberar_clientes();
+        stats_atender();
+    }
+    unlink(ruta);
+    return 1;
+}
@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include "myshell.h"
+
+extern char** environ;
+
+// Por defecto posix_spawn: no copia las tablas de paginas de la shell en cada comando
+tModoSpawn modo_spawn = SPAWN_POSIX;
+
+int parsear_modo_spawn(const char* nombre) {
+    if (strcmp(nombre, "fork") == 0) {
+        modo_spawn = SPAWN_FORK;
+    } else if (strcmp(nombre, "posix") == 0 || strcmp(nombre, "vfork") == 0) {
+        modo_spawn = SPAWN_POSIX;
+    } else if (strcmp(nombre, "zygote") == 0) {
+        modo_spawn = SPAWN_ZYGOTE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char* nombre_modo_spawn(tModoSpawn modo) {
+    return modo == SPAWN_FORK ? "fork" : modo == SPAWN_ZYGOTE ? "zygote" : "posix";
+}
+
+// Señales que la shell ignora o captura y que el hijo debe tener por defecto
+static void senales_hijo(sigset_t* set) {
+    sigemptyset(set);
+    sigaddset(set, SIGINT); sigaddset(set, SIGQUIT);
+    sigaddset(set, SIGTSTP); sigaddset(set, SIGTTOU); sigaddset(set, SIGTTIN);
+}
+
+// Lo que hace el hijo de fork (o del zygote) antes del exec. Con terminal >= 0
+// el hijo se lo da a su grupo: asi no lee del terminal antes de que la shell
+// haga su tcsetpgrp, que con el zygote llega despues de un viaje por el socket
+void preparar_hijo(const tLanzamiento* l, const char* ruta, int terminal) {
+    setpgid(0, l->pgid);
+    if (terminal >= 0) {
+        tcsetpgrp(terminal, getpgrp()); // SIGTTOU aun esta ignorada
+    }
+
+    // Restaurar señales a default
+    signal(SIGINT, SIG_DFL); signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL); signal(SIGTTOU, SIG_DFL); signal(SIGTTIN, SIG_DFL);
+    // La shell interactiva bloquea SIGINT para leerlo de un signalfd
+    sigset_t vacia;
+    sigemptyset(&vacia);
+    sigprocmask(SIG_SETMASK, &vacia, NULL);
+
+    //dup2 duplica un descriptor de archivo y lo ridirige al especificado.
+    // Pipes y redirecciones ya estan abiertos por el padre
+    if (l->fd_entrada >= 0) dup2(l->fd_entrada, STDIN_FILENO);
+    if (l->fd_salida >= 0) dup2(l->fd_salida, STDOUT_FILENO);
+    if (l->fd_error >= 0) dup2(l->fd_error, STDERR_FILENO);
+    if (l->unir_error) dup2(STDOUT_FILENO, STDERR_FILENO);
+
+    // CPUs, politica, nice y E/S antes del exec: lo que cree el comando los
+    // hereda. Despues de los dup2 para que los avisos salgan por su stderr
+    if (l->colocacion) aplicar_colocacion(l->colocacion);
+
+    execv(ruta, l->argv);
+    // Usar stderr para que el error no se pierda en pipes
+    fprintf(stderr, "%s: Error. %s\n", l->argv[0], strerror(errno));
+    // _exit: los buffers heredados (stdout, la traza) son del padre y no se
+    // deben volcar otra vez desde el hijo
+    _exit(127);
+}
+
+// Backend clasico: el hijo se prepara a si mismo antes del exec
+
+static pid_t lanzar_fork(const tLanzamiento* l, const char* ruta) {
+    pid_t pid = fork();
+
+    if (pid == 0) { // Hijo
+        preparar_hijo(l, ruta, l->primer_plano ? STDIN_FILENO : -1);
+    }
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    setpgid(pid, l->pgid ? l->pgid : pid);
+    return pid;
+}
+
+// Backend posix_spawn: las redirecciones, el grupo y las señales se describen
+// como acciones y glibc las aplica en un hijo que comparte memoria con el padre
+// hasta el exec, asi que el coste no depende del tamaño de la shell
+
+pid_t lanzar_posix(const tLanzamiento* l, const char* ruta) {
+    posix_spawn_file_actions_t acciones;
+    posix_spawnattr_t atributos;
+    sigset_t por_defecto, vacia;
+    pid_t pid = -1;
+
+    // posix_spawn no sabe aplicar CPUs, nice ni prioridad de E/S (y su
+    // politica solo admite SCHED_OTHER y las de tiempo real): una etapa con
+    // colocacion la prepara un hijo de fork, sin tocar la de la shell
+    if (l->colocacion) {
+        return lanzar_fork(l, ruta);
+    }
+
+    posix_spawn_file_actions_init(&acciones);
+#if __GLIBC_PREREQ(2, 35)
+    // Antes de los dup2: la entrada estandar aun es el terminal de la shell
+    if (l->primer_plano) posix_spawn_file_actions_addtcsetpgrp_np(&acciones, STDIN_FILENO);
+#endif
+    if (l->fd_entrada >= 0) posix_spawn_file_actions_adddup2(&acciones, l->fd_entrada, STDIN_FILENO);
+    if (l->fd_salida >= 0) posix_spawn_file_actions_adddup2(&acciones, l->fd_salida, STDOUT_FILENO);
+    if (l->fd_error >= 0) posix_spawn_file_actions_adddup2(&acciones, l->fd_error, STDERR_FILENO);
+    if (l->unir_error) posix_spawn_file_actions_adddup2(&acciones, STDOUT_FILENO, STDERR_FILENO);
+
+    posix_spawnattr_init(&atributos);
+    senales_hijo(&por_defecto);
+    sigemptyset(&vacia);
+    posix_spawnattr_setsigdefault(&atributos, &por_defecto);
+    posix_spawnattr_setsigmask(&atributos, &vacia);
+    posix_spawnattr_setpgroup(&atributos, l->pgid);
+    posix_spawnattr_setflags(&atributos, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF
+                                         | POSIX_SPAWN_SETSIGMASK);
+
+    int error = posix_spawn(&pid, ruta, &acciones, &atributos, l->argv, environ);
+
+    posix_spawnattr_destroy(&atributos);
+    posix_spawn_file_actions_destroy(&acciones);
+
+    if (error != 0) {
+        fprintf(stderr, "%s: Error. %s\n", l->argv[0], strerror(error));
+        return -1;
+    }
+    // El hijo ya puede haber hecho exec (EACCES): el grupo lo fijo posix_spawn
+    setpgid(pid, l->pgid ? l->pgid : pid);
+    return pid;
+}
+
+pid_t lanzar_proceso(const tLanzamiento* l) {
+    // La ruta se resuelve en el padre con la tabla hash: un comando que no
+    // existe se detecta sin crear ningun proceso
+    const char* ruta = hash_buscar(l->argv[0]);
+    if (ruta == NULL) {
+        fprintf(stderr, "%s: no se encuentra\n", l->argv[0]);
+        return -1;
+    }
+    uint64_t inicio = stats_inicio();
+    pid_t pid = modo_spawn == SPAWN_FORK ? lanzar_fork(l, ruta)
+              : modo_spawn == SPAWN_ZYGOTE ? lanzar_zygote(l, ruta)
+              : lanzar_posix(l, ruta);
+    stats_fin(ST_LANZAR, inicio);
+    traza_hijo(pid, l->argv[0]);
+    return pid;
+}
+
+// Plan de redirecciones: cada fichero se abre una vez, con O_CLOEXEC, y el
+// mismo descriptor sirve para cualquier backend (dup2 o adddup2)
+
+static int abrir_redireccion(const char* fichero, int flags) {
+    int fd = open(fichero, flags | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "%s: Error. %s\n", fichero, strerror(errno));
+    }
+    return fd;
+}
+
+int abrir_redirecciones(const tline* linea, tRedirecciones* r) {
+    r->entrada = r->salida = r->error = -1;
+
+    if (linea->redirect_input) {
+        int flags = linea->inout_input ? O_RDWR | O_CREAT : O_RDONLY;
+        if ((r->entrada = abrir_redireccion(linea->redirect_input, flags)) < 0) {
+            return -1;
+        }
+    }
+    if (linea->redirect_output) {
+        int flags = O_WRONLY | O_CREAT | (linea->append_output ? O_APPEND : O_TRUNC);
+        if ((r->salida = abrir_redireccion(linea->redirect_output, flags)) < 0) {
+            cerrar_redirecciones(r);
+            return -1;
+        }
+    }
+    if (linea->redirect_error) {
+        if ((r->error = abrir_redireccion(linea->redirect_error, O_WRONLY | O_CREAT | O_TRUNC)) < 0) {
+            cerrar_redirecciones(r);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void cerrar_redirecciones(tRedirecciones* r) {
+    if (r->entrada >= 0) close(r->entrada);
+    if (r->salida >= 0) close(r->salida);
+    if (r->error >= 0) close(r->error);
+    r->entrada = r->salida = r->error = -1;
+}
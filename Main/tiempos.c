@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "myshell.h"
+
+// Contabilidad de recursos de los hijos: lo que devuelve wait4/waitid en
+// struct rusage mas el tiempo real medido por la shell
+
+// Con --resumen o MSH_RESUMEN=1 cada comando en primer plano imprime una linea
+int mostrar_resumen = 0;
+
+double tiempo_ahora() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double segundos(struct timeval t) {
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+static void sumar_tiempo(struct timeval* a, struct timeval b) {
+    a->tv_sec += b.tv_sec;
+    a->tv_usec += b.tv_usec;
+    if (a->tv_usec >= 1000000) {
+        a->tv_sec++;
+        a->tv_usec -= 1000000;
+    }
+}
+
+void uso_sumar(struct rusage* total, const struct rusage* uso) {
+    sumar_tiempo(&total->ru_utime, uso->ru_utime);
+    sumar_tiempo(&total->ru_stime, uso->ru_stime);
+    if (uso->ru_maxrss > total->ru_maxrss) total->ru_maxrss = uso->ru_maxrss;
+    total->ru_minflt += uso->ru_minflt;
+    total->ru_majflt += uso->ru_majflt;
+    total->ru_nvcsw += uso->ru_nvcsw;
+    total->ru_nivcsw += uso->ru_nivcsw;
+}
+
+static void restar_tiempo(struct timeval* a, struct timeval b) {
+    a->tv_sec -= b.tv_sec;
+    a->tv_usec -= b.tv_usec;
+    if (a->tv_usec < 0) {
+        a->tv_sec--;
+        a->tv_usec += 1000000;
+    }
+}
+
+// Lo gastado entre dos getrusage. maxrss es un maximo, no se resta
+void uso_restar(struct rusage* uso, const struct rusage* antes) {
+    restar_tiempo(&uso->ru_utime, antes->ru_utime);
+    restar_tiempo(&uso->ru_stime, antes->ru_stime);
+    uso->ru_minflt -= antes->ru_minflt;
+    uso->ru_majflt -= antes->ru_majflt;
+    uso->ru_nvcsw -= antes->ru_nvcsw;
+    uso->ru_nivcsw -= antes->ru_nivcsw;
+}
+
+// Codigo de salida al estilo shell: exit status o 128 + señal
+int codigo_salida(int estatus) {
+    if (WIFEXITED(estatus)) return WEXITSTATUS(estatus);
+    if (WIFSIGNALED(estatus)) return 128 + WTERMSIG(estatus);
+    return 0;
+}
+
+void imprimir_uso(FILE* f, const struct rusage* uso) {
+    fprintf(f, "user %.3fs sys %.3fs maxrss %ldKiB flt %ld/%ld ctx %ld/%ld",
+            segundos(uso->ru_utime), segundos(uso->ru_stime), uso->ru_maxrss,
+            uso->ru_minflt, uso->ru_majflt, uso->ru_nvcsw, uso->ru_nivcsw);
+}
+
+// Informe de time: total y, si es una pipeline, una linea por etapa
+void informe_tiempos(double real, const tResultado* etapas, int n, char** nombres) {
+    struct rusage total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < n; i++) {
+        uso_sumar(&total, &etapas[i].uso);
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "real %.3fs ", real);
+    imprimir_uso(stderr, &total);
+    fprintf(stderr, "\n");
+    if (n > 1) {
+        for (int i = 0; i < n; i++) {
+            fprintf(stderr, "  [%d] %-12s estado %-3d ", i, nombres[i], etapas[i].estado);
+            imprimir_uso(stderr, &etapas[i].uso);
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+// Resumen en una linea tras cada comando con --resumen
+void resumen_comando(double real, const tResultado* etapas, int n) {
+    struct rusage total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < n; i++) {
+        uso_sumar(&total, &etapas[i].uso);
+    }
+    fflush(stdout);
+    fprintf(stderr, "msh: estado %d real %.3fs ", n > 0 ? etapas[n - 1].estado : 0, real);
+    imprimir_uso(stderr, &total);
+    fprintf(stderr, "\n");
+}
+
+// Totales de un job en segundo plano, para el aviso de Done
+void resumen_job(char* buf, size_t tam, const tJob* job) {
+    snprintf(buf, tam, "real %.3fs user %.3fs sys %.3fs maxrss %ldKiB",
+             tiempo_ahora() - job->inicio, segundos(job->uso.ru_utime),
+             segundos(job->uso.ru_stime), job->uso.ru_maxrss);
+}
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "parser.h"
+#include "myshell.h"
+
+// Traza del ciclo de vida de los comandos en el formato de eventos de Chrome
+// (chrome://tracing, ui.perfetto.dev).
+//
+// Los puntos de medida de la telemetria (tokenize, internas, lanzamientos,
+// tcsetpgrp, esperas, prompt) dejan aqui tambien un evento con su duracion;
+// ademas cada hijo tiene su propia pista, de su lanzamiento a su recogida.
+// Los eventos van a un anillo preasignado sin cerrojos (la shell tiene un
+// unico hilo y ningun manejador de señal escribe en el) y solo se formatean
+// al volcarlo, cuando se llena o al cerrar la traza: anotar es copiar unos
+// campos. Se usa el formato de array JSON, que admite que falte el ']'
+// final: una shell que muere sin cerrar la traza deja un fichero legible.
+//
+// Se activa con --trace=fichero, MSH_TRACE=fichero o `trace on [fichero]`.
+
+#define CAPACIDAD_ANILLO 8192
+#define LARGO_DETALLE 32
+
+typedef enum { EV_DURACION, EV_INSTANTE, EV_NOMBRE_PISTA } tTipoEvento;
+
+typedef struct {
+    tTipoEvento tipo;
+    const char* nombre;         // literal; NULL para usar detalle
+    uint64_t inicio;
+    uint64_t duracion;
+    int pista;                  // tid: la shell o el pid de un hijo
+    const char* clave;          // argumento numerico opcional
+    long valor;
+    char detalle[LARGO_DETALLE];
+} tEvento;
+
+typedef struct {
+    pid_t pid;                  // 0 libre, -1 borrado
+    uint64_t inicio;
+    char nombre[LARGO_DETALLE];
+} tHijoTrazado;
+
+int traza_activa = 0;
+static tEvento* anillo = NULL;
+static int nanillo = 0;
+static FILE* fichero = NULL;
+static char* ruta_traza = NULL;
+static pid_t pid_shell = 0;
+static int primero = 1;         // aun no se ha escrito ningun evento
+
+static tHijoTrazado* hijos = NULL;
+static int capacidad_hijos = 0;
+static int ocupados_hijos = 0;  // vivos y borrados
+
+// El volcado formatea a mano en un buffer: fprintf costaria mas que todo
+// lo que se ahorra anotando en el anillo
+
+typedef struct {
+    char datos[512];
+    int n;
+} tTexto;
+
+static void poner(tTexto* t, const char* s) {
+    size_t largo = strlen(s);
+    memcpy(t->datos + t->n, s, largo);
+    t->n += largo;
+}
+
+static void poner_entero(tTexto* t, unsigned long long v) {
+    char cifras[24];
+    int i = sizeof(cifras);
+    do {
+        cifras[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    memcpy(t->datos + t->n, cifras + i, sizeof(cifras) - i);
+    t->n += sizeof(cifras) - i;
+}
+
+// ns como microsegundos con tres decimales, que es lo que espera el formato
+static void poner_us(tTexto* t, uint64_t ns) {
+    poner_entero(t, ns / 1000);
+    unsigned resto = ns % 1000;
+    char decimales[4] = {'.', '0' + resto / 100, '0' + resto / 10 % 10, '0' + resto % 10};
+    memcpy(t->datos + t->n, decimales, 4);
+    t->n += 4;
+}
+
+// Los textos caben de sobra: como mucho LARGO_DETALLE caracteres escapados
+static void poner_cadena(tTexto* t, const char* s) {
+    t->datos[t->n++] = '"';
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            t->datos[t->n++] = '\\';
+            t->datos[t->n++] = c;
+        } else if (c < 0x20) {
+            t->n += snprintf(t->datos + t->n, 7, "\\u%04x", c);
+        } else {
+            t->datos[t->n++] = c;
+        }
+    }
+    t->datos[t->n++] = '"';
+}
+
+static void escribir_evento(FILE* f, const tEvento* e) {
+    const char* nombre = e->nombre ? e->nombre : e->detalle;
+    tTexto t = {.n = 0};
+    poner(&t, primero ? "\n{\"pid\":" : ",\n{\"pid\":");
+    primero = 0;
+    poner_entero(&t, pid_shell);
+    poner(&t, ",\"tid\":");
+    poner_entero(&t, e->pista);
+    if (e->tipo == EV_NOMBRE_PISTA) {
+        poner(&t, ",\"ph\":\"M\",\"name\":\"thread_name\",\"args\":{\"name\":");
+        poner_cadena(&t, nombre);
+        poner(&t, "}}");
+        fwrite(t.datos, 1, t.n, f);
+        return;
+    }
+    poner(&t, ",\"name\":");
+    poner_cadena(&t, nombre);
+    poner(&t, ",\"ts\":");
+    poner_us(&t, e->inicio);
+    if (e->tipo == EV_DURACION) {
+        poner(&t, ",\"ph\":\"X\",\"dur\":");
+        poner_us(&t, e->duracion);
+    } else {
+        poner(&t, ",\"ph\":\"i\",\"s\":\"t\"");
+    }
+    const char* separador = ",\"args\":{";
+    if (e->clave) {
+        poner(&t, separador);
+        poner_cadena(&t, e->clave);
+        poner(&t, ":");
+        if (e->valor < 0) poner(&t, "-");
+        poner_entero(&t, e->valor < 0 ? -(unsigned long long)e->valor : (unsigned long long)e->valor);
+        separador = ",";
+    }
+    if (e->nombre && e->detalle[0]) {
+        poner(&t, separador);
+        poner(&t, "\"detalle\":");
+        poner_cadena(&t, e->detalle);
+        separador = ",";
+    }
+    if (separador[0] == ',' && separador[1] == '\0') {
+        poner(&t, "}");
+    }
+    poner(&t, "}");
+    fwrite(t.datos, 1, t.n, f);
+}
+
+static void volcar_anillo() {
+    if (fichero) {
+        for (int i = 0; i < nanillo; i++) {
+            escribir_evento(fichero, &anillo[i]);
+        }
+    }
+    nanillo = 0;
+}
+
+static tEvento* nuevo_evento(tTipoEvento tipo, const char* nombre, int pista) {
+    if (nanillo == CAPACIDAD_ANILLO) {
+        volcar_anillo();
+    }
+    tEvento* e = &anillo[nanillo++];
+    e->tipo = tipo;
+    e->nombre = nombre;
+    e->pista = pista;
+    e->clave = NULL;
+    e->detalle[0] = '\0';
+    return e;
+}
+
+static void copiar_detalle(char* destino, const char* texto) {
+    if (texto == NULL) {
+        destino[0] = '\0';
+        return;
+    }
+    size_t n = strnlen(texto, LARGO_DETALLE - 1);
+    memcpy(destino, texto, n);
+    destino[n] = '\0';
+}
+
+void traza_evento(const char* nombre, uint64_t inicio, uint64_t fin, const char* detalle) {
+    if (!traza_activa) {
+        return;
+    }
+    tEvento* e = nuevo_evento(EV_DURACION, nombre, (int)pid_shell);
+    e->inicio = inicio;
+    e->duracion = fin - inicio;
+    copiar_detalle(e->detalle, detalle);
+}
+
+void traza_instante(const char* nombre, const char* clave, long valor) {
+    if (!traza_activa) {
+        return;
+    }
+    tEvento* e = nuevo_evento(EV_INSTANTE, nombre, (int)pid_shell);
+    e->inicio = stats_reloj();
+    e->clave = clave;
+    e->valor = valor;
+}
+
+// Hijos en vuelo: tabla hash abierta por pid
+
+static int ranura_hijo(pid_t pid) {
+    return (int)(((uint32_t)pid * 2654435761u) & (capacidad_hijos - 1));
+}
+
+static void insertar_hijo(const tHijoTrazado* h) {
+    int i = ranura_hijo(h->pid);
+    while (hijos[i].pid > 0) i = (i + 1) & (capacidad_hijos - 1);
+    if (hijos[i].pid == 0) ocupados_hijos++;
+    hijos[i] = *h;
+}
+
+static void crecer_hijos() {
+    tHijoTrazado* viejos = hijos;
+    int capacidad_vieja = capacidad_hijos;
+    // Si la mayoria son borrados basta con rehacer la tabla del mismo tamaño
+    int vivos = 0;
+    for (int i = 0; i < capacidad_vieja; i++) vivos += viejos[i].pid > 0;
+    capacidad_hijos = capacidad_vieja == 0 ? 64
+                    : vivos * 4 >= capacidad_vieja ? capacidad_vieja * 2 : capacidad_vieja;
+    hijos = calloc(capacidad_hijos, sizeof(tHijoTrazado));
+    ocupados_hijos = 0;
+    for (int i = 0; i < capacidad_vieja; i++) {
+        if (viejos[i].pid > 0) insertar_hijo(&viejos[i]);
+    }
+    free(viejos);
+}
+
+// Se llama con cada hijo recien lanzado
+void traza_hijo(pid_t pid, const char* nombre) {
+    if (!traza_activa || pid <= 0) {
+        return;
+    }
+    if ((ocupados_hijos + 1) * 2 > capacidad_hijos) {
+        crecer_hijos();
+    }
+    tHijoTrazado h = {.pid = pid, .inicio = stats_reloj()};
+    copiar_detalle(h.nombre, nombre);
+    insertar_hijo(&h);
+}
+
+// Se llama en cada sitio donde se recoge un hijo
+void traza_hijo_fin(pid_t pid) {
+    if (!traza_activa || capacidad_hijos == 0 || pid <= 0) {
+        return;
+    }
+    int i = ranura_hijo(pid);
+    while (hijos[i].pid != 0) {
+        if (hijos[i].pid == pid) {
+            tEvento* e = nuevo_evento(EV_NOMBRE_PISTA, NULL, pid);
+            copiar_detalle(e->detalle, hijos[i].nombre);
+            e = nuevo_evento(EV_DURACION, NULL, pid);
+            e->inicio = hijos[i].inicio;
+            e->duracion = stats_reloj() - hijos[i].inicio;
+            copiar_detalle(e->detalle, hijos[i].nombre);
+            hijos[i].pid = -1;
+            return;
+        }
+        i = (i + 1) & (capacidad_hijos - 1);
+    }
+}
+
+void traza_cerrar() {
+    if (fichero == NULL || getpid() != pid_shell) {
+        return; // Un hijo de fork que sale antes del exec no escribe nada
+    }
+    volcar_anillo();
+    fprintf(fichero, "\n]\n");
+    fclose(fichero);
+    fichero = NULL;
+    traza_activa = 0;
+    free(hijos);
+    hijos = NULL;
+    capacidad_hijos = 0;
+    ocupados_hijos = 0;
+}
+
+int traza_abrir(const char* ruta) {
+    FILE* f = fopen(ruta, "we");
+    if (f == NULL) {
+        fprintf(stderr, "%s: Error. %s\n", ruta, strerror(errno));
+        return -1;
+    }
+    traza_cerrar();
+    if (anillo == NULL) {
+        anillo = malloc(CAPACIDAD_ANILLO * sizeof(tEvento));
+    }
+    if (pid_shell == 0) {
+        atexit(traza_cerrar);
+    }
+    pid_shell = getpid();
+    setvbuf(f, NULL, _IOFBF, 1 << 16);
+    fichero = f;
+    free(ruta_traza);
+    ruta_traza = strdup(ruta);
+    primero = 1;
+    nanillo = 0;
+    fprintf(f, "[");
+    tEvento* e = nuevo_evento(EV_NOMBRE_PISTA, "miniShell", (int)pid_shell);
+    copiar_detalle(e->detalle, "miniShell");
+    traza_activa = 1;
+    return 0;
+}
+
+void traza_iniciar() {
+    char* ruta = getenv("MSH_TRACE");
+    if (ruta && ruta[0] != '\0') {
+        traza_abrir(ruta);
+    }
+}
+
+// trace [on [fichero] | off]
+
+int manejador_trace(tline* linea) {
+    tcommand cmd = linea->commands[0];
+    if (cmd.argc == 1) {
+        if (traza_activa) {
+            printf("traza activa en %s (%d eventos sin volcar)\n", ruta_traza, nanillo);
+        } else {
+            printf("traza desactivada (trace on [fichero])\n");
+        }
+        return 0;
+    }
+    if (strcmp(cmd.argv[1], "on") == 0 && cmd.argc <= 3) {
+        char defecto[64];
+        snprintf(defecto, sizeof(defecto), "msh-%d.trace.json", (int)getpid());
+        return traza_abrir(cmd.argc == 3 ? cmd.argv[2] : defecto) < 0 ? 1 : 0;
+    }
+    if (strcmp(cmd.argv[1], "off") == 0 && cmd.argc == 2) {
+        traza_cerrar();
+        return 0;
+    }
+    fprintf(stderr, "trace: uso: trace [on [fichero] | off]\n");
+    return 2;
+}
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "myshell.h"
+
+// Tamaño de los buffers de las pipes entre etapas.
+//
+// Por defecto el kernel da 64 KiB; con un tamaño fijo se aplica F_SETPIPE_SZ
+// a cada pipe al crearla, limitado por /proc/sys/fs/pipe-max-size. En modo
+// adaptativo las pipes empiezan con el tamaño por defecto y, mientras la shell
+// espera a la pipeline, cada muestra reabre la pipe por /proc/<lector>/fd/0:
+// si en dos muestras seguidas esta llena (la etapa que escribe esta bloqueada)
+// su buffer se multiplica por cuatro, hasta el maximo. La shell no se queda
+// con una copia de la pipe: eso impediria el SIGPIPE al que escribe cuando
+// el lector termina.
+
+#define MUESTREO_MS 20
+#define MUESTRAS_LLENA 2
+
+tTamPipe tam_pipe = {TP_DEFECTO, 0};
+
+typedef struct {
+    pid_t lector;       // etapa que lee de la pipe por su entrada estandar
+    ino_t inodo;        // para no confundirla si el lector cambia su entrada
+    int llena;          // muestras seguidas con la pipe llena
+} tPipeVigilada;
+
+static tPipeVigilada* vigiladas = NULL;
+static int nvigiladas = 0;
+static int capacidad_vigiladas = 0;
+static int muestreo_activo = 0;     // hay un timer de muestreo pendiente
+
+int vigilar_tuberias = 0;
+
+int tam_pipe_maximo() {
+    static int maximo = 0;
+    if (maximo == 0) {
+        FILE* f = fopen("/proc/sys/fs/pipe-max-size", "re");
+        if (f == NULL || fscanf(f, "%d", &maximo) != 1) {
+            maximo = 1024 * 1024;
+        }
+        if (f) fclose(f);
+    }
+    return maximo;
+}
+
+// "0" o "defecto", "auto", "max" o un numero con sufijo K/M opcional
+int parsear_tam_pipe(const char* texto, tTamPipe* tam) {
+    if (strcmp(texto, "0") == 0 || strcmp(texto, "defecto") == 0) {
+        *tam = (tTamPipe){TP_DEFECTO, 0};
+        return 0;
+    }
+    if (strcmp(texto, "auto") == 0) {
+        *tam = (tTamPipe){TP_AUTO, 0};
+        return 0;
+    }
+    if (strcmp(texto, "max") == 0) {
+        *tam = (tTamPipe){TP_FIJO, tam_pipe_maximo()};
+        return 0;
+    }
+    char* fin;
+    long bytes = strtol(texto, &fin, 10);
+    if (*fin == 'k' || *fin == 'K') { bytes *= 1024; fin++; }
+    else if (*fin == 'm' || *fin == 'M') { bytes *= 1024 * 1024; fin++; }
+    if (fin == texto || *fin != '\0' || bytes <= 0) {
+        return -1;
+    }
+    if (bytes > tam_pipe_maximo()) {
+        bytes = tam_pipe_maximo();
+    }
+    *tam = (tTamPipe){TP_FIJO, (int)bytes};
+    return 0;
+}
+
+void describir_tam_pipe(const tTamPipe* tam, char* buf, size_t largo) {
+    if (tam->modo == TP_AUTO) {
+        snprintf(buf, largo, "auto (hasta %d)", tam_pipe_maximo());
+    } else if (tam->modo == TP_FIJO) {
+        snprintf(buf, largo, "%d", tam->bytes);
+    } else {
+        snprintf(buf, largo, "defecto");
+    }
+}
+
+// Se llama con cada pipe recien creada en lanzar_pipeline
+void configurar_tuberia(int fd_lectura) {
+    if (tam_pipe.modo == TP_FIJO) {
+        // Puede fallar por los limites por usuario: se queda el tamaño por defecto
+        fcntl(fd_lectura, F_SETPIPE_SZ, tam_pipe.bytes);
+    }
+}
+
+// Se llama cuando ya esta lanzada la etapa lector, que lee de fd_lectura
+void vigilar_tuberia(pid_t lector, int fd_lectura) {
+    struct stat st;
+    if (tam_pipe.modo != TP_AUTO || !vigilar_tuberias || fstat(fd_lectura, &st) < 0) {
+        return;
+    }
+    if (nvigiladas >= capacidad_vigiladas) {
+        capacidad_vigiladas = capacidad_vigiladas ? capacidad_vigiladas * 2 : 16;
+        vigiladas = realloc(vigiladas, capacidad_vigiladas * sizeof(tPipeVigilada));
+    }
+    vigiladas[nvigiladas++] = (tPipeVigilada){lector, st.st_ino, 0};
+}
+
+int tuberias_vigiladas() {
+    return nvigiladas;
+}
+
+// Una muestra: crece el buffer de las pipes que siguen llenas
+void muestrear_tuberias() {
+    char ruta[64];
+    for (int i = 0; i < nvigiladas; i++) {
+        tPipeVigilada* p = &vigiladas[i];
+        if (p->lector <= 0) {
+            continue;
+        }
+        // Abrir el extremo de lectura de una pipe nunca bloquea con O_NONBLOCK
+        snprintf(ruta, sizeof(ruta), "/proc/%d/fd/0", (int)p->lector);
+        int fd = open(ruta, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0 || st.st_ino != p->inodo) {
+            p->lector = 0; // Ha terminado o ya no lee de la pipe
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        int pendientes = 0, tam = fcntl(fd, F_GETPIPE_SZ);
+        if (tam > 0 && ioctl(fd, FIONREAD, &pendientes) == 0) {
+            if (pendientes < tam - 4096) {
+                p->llena = 0;
+            } else if (++p->llena >= MUESTRAS_LLENA && tam < tam_pipe_maximo()) {
+                int nuevo = tam * 4 < tam_pipe_maximo() ? tam * 4 : tam_pipe_maximo();
+                fcntl(fd, F_SETPIPE_SZ, nuevo);
+                p->llena = 0;
+            }
+        }
+        close(fd);
+    }
+}
+
+void soltar_tuberias() {
+    nvigiladas = 0;
+}
+
+static void muestreo_periodico(void* datos) {
+    (void)datos;
+    muestreo_activo = 0;
+    if (nvigiladas > 0) {
+        muestrear_tuberias();
+        muestreo_activo = eventos_timer(MUESTREO_MS, muestreo_periodico, NULL) == 0;
+    }
+}
+
+// Arranca el muestreo mientras la shell espera a la pipeline en primer plano
+void iniciar_muestreo_tuberias() {
+    if (nvigiladas > 0 && eventos_activo() && !muestreo_activo) {
+        muestreo_activo = eventos_timer(MUESTREO_MS, muestreo_periodico, NULL) == 0;
+    }
+}
+
+// Sin bucle de eventos: espera a pid muestreando las pipes cada MUESTREO_MS.
+// Un pidfd despierta en cuanto termina; sin pidfd se comprueba en cada muestra
+pid_t esperar_muestreando(pid_t pid, int* estatus, struct rusage* uso) {
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    pid_t r;
+    while ((r = wait4(pid, estatus, WNOHANG, uso)) == 0) {
+        struct pollfd pfd = {.fd = pidfd, .events = POLLIN};
+        poll(&pfd, pidfd >= 0 ? 1 : 0, MUESTREO_MS);
+        muestrear_tuberias();
+    }
+    if (pidfd >= 0) close(pidfd);
+    return r;
+}
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "myshell.h"
+
+// Servidor de lanzamientos ("zygote").
+//
+// Al arrancar, antes de cargar el historial o el indice de comandos, la shell
+// crea un proceso auxiliar que apenas tiene memoria propia. Con --spawn=zygote
+// cada lanzamiento se le pide por un socketpair SOCK_SEQPACKET: la ruta, argv,
+// el grupo, la colocacion de la etapa y los descriptores de entrada, salida y
+// error (SCM_RIGHTS). El
+// zygote crea el hijo con clone(CLONE_PARENT), asi que su padre es la shell:
+// pidfds, wait4 y el reaper funcionan igual que con los otros backends, y el
+// coste del fork es el de copiar las tablas de paginas del zygote, no las de
+// la shell. El directorio de trabajo y la umask se le mandan con la peticion
+// siguiente a un cd o un umask. Si el zygote no esta o la peticion no cabe en
+// un mensaje, el lanzamiento se hace con posix_spawn.
+
+#define MAX_PETICION (64 * 1024)
+
+typedef struct {
+    pid_t pgid;
+    int unir_error;
+    int nargs;
+    int primer_plano;           // lleva el terminal de la shell
+    int con_estado;             // lleva el cwd (ultimo descriptor) y la umask
+    mode_t mascara;
+    int con_colocacion;
+    tColocacionEtapa colocacion; // la aplica el hijo antes del exec
+} tPeticion;
+
+typedef struct {
+    pid_t pid;                  // -1 si no se pudo crear
+    int error;
+} tRespuesta;
+
+static int zygote_fd = -1;      // extremo de la shell
+static int estado_sucio = 0;
+
+// Lado del zygote
+
+// Descriptores: entrada, salida, error, [terminal], [cwd]
+static void atender_peticion(int fd, char* buf, int* fds, int nfds) {
+    tPeticion p;
+    memcpy(&p, buf, sizeof(p));
+    if (nfds != 3 + (p.primer_plano != 0) + (p.con_estado != 0)) {
+        tRespuesta r = {-1, EINVAL};
+        send(fd, &r, sizeof(r), MSG_NOSIGNAL);
+        return;
+    }
+    if (p.con_estado) {
+        fchdir(fds[nfds - 1]);
+        umask(p.mascara);
+    }
+
+    // ruta\0argv[0]\0...argv[n-1]\0
+    char* argv[p.nargs + 1];
+    char* ruta = buf + sizeof(p);
+    char* s = ruta + strlen(ruta) + 1;
+    for (int i = 0; i < p.nargs; i++) {
+        argv[i] = s;
+        s += strlen(s) + 1;
+    }
+    argv[p.nargs] = NULL;
+
+    tLanzamiento l = {
+        .argv = argv, .pgid = p.pgid,
+        .fd_entrada = fds[0], .fd_salida = fds[1], .fd_error = fds[2],
+        .unir_error = p.unir_error,
+        .colocacion = p.con_colocacion ? &p.colocacion : NULL,
+    };
+    // Como fork, pero el padre del hijo es la shell
+    pid_t pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, 0);
+    if (pid == 0) {
+        preparar_hijo(&l, ruta, p.primer_plano ? fds[3] : -1);
+    }
+    tRespuesta r = {pid, pid < 0 ? errno : 0};
+    send(fd, &r, sizeof(r), MSG_NOSIGNAL);
+}
+
+static void bucle_zygote(int fd) {
+    // Va en el grupo de la shell: el Ctrl-C del prompt no es para el
+    signal(SIGINT, SIG_IGN); signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN); signal(SIGTTOU, SIG_IGN); signal(SIGTTIN, SIG_IGN);
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    prctl(PR_SET_NAME, "msh-zygote");
+
+    // No se queda con el terminal ni con las pipes de la shell
+    if (fd < 3) fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+    int nulo = open("/dev/null", O_RDWR);
+    for (int i = 0; i < 3; i++) dup2(nulo, i);
+    if (nulo > 2) close(nulo);
+    if (fd > 3) {
+        dup3(fd, 3, O_CLOEXEC);
+        fd = 3;
+    }
+    close_range(4, ~0U, 0);
+
+    static char buf[MAX_PETICION];
+    while (1) {
+        union {
+            char datos[CMSG_SPACE(5 * sizeof(int))];
+            struct cmsghdr alineacion;
+        } control;
+        struct iovec iov = {buf, sizeof(buf) - 1};
+        struct msghdr msg = {
+            .msg_iov = &iov, .msg_iovlen = 1,
+            .msg_control = control.datos, .msg_controllen = sizeof(control.datos),
+        };
+        // Los descriptores recibidos son O_CLOEXEC: el hijo solo se queda
+        // con las copias que hace dup2 sobre 0, 1 y 2
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            _exit(0); // La shell ha terminado
+        }
+        int fds[5];
+        int nfds = 0;
+        struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(c), nfds * sizeof(int));
+        }
+        if (nfds >= 3 && n >= (ssize_t)sizeof(tPeticion)) {
+            buf[n] = '\0';
+            atender_peticion(fd, buf, fds, nfds);
+        } else {
+            tRespuesta r = {-1, EINVAL};
+            send(fd, &r, sizeof(r), MSG_NOSIGNAL);
+        }
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+    }
+}
+
+// Lado de la shell
+
+int zygote_iniciar() {
+    int par[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, par) != 0) {
+        return -1;
+    }
+    fflush(NULL); // Que el zygote no herede nada pendiente de escribir
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(par[0]);
+        close(par[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(par[0]);
+        bucle_zygote(par[1]);
+    }
+    close(par[1]);
+    zygote_fd = par[0];
+    estado_sucio = 0;
+    return 0;
+}
+
+void zygote_estado_cambiado() {
+    estado_sucio = 1;
+}
+
+pid_t lanzar_zygote(const tLanzamiento* l, const char* ruta) {
+    if (zygote_fd < 0) {
+        return lanzar_posix(l, ruta);
+    }
+    char buf[MAX_PETICION];
+    tPeticion p = {.pgid = l->pgid, .unir_error = l->unir_error};
+    if (l->colocacion) {
+        p.con_colocacion = 1;
+        p.colocacion = *l->colocacion;
+    }
+    size_t n = sizeof(p);
+    size_t largo = strlen(ruta) + 1;
+    if (n + largo > sizeof(buf)) {
+        return lanzar_posix(l, ruta);
+    }
+    memcpy(buf + n, ruta, largo);
+    n += largo;
+    for (; l->argv[p.nargs]; p.nargs++) {
+        largo = strlen(l->argv[p.nargs]) + 1;
+        if (n + largo >= sizeof(buf)) {
+            return lanzar_posix(l, ruta); // No cabe en un mensaje
+        }
+        memcpy(buf + n, l->argv[p.nargs], largo);
+        n += largo;
+    }
+
+    // Siempre se pasan los tres: el zygote no tiene los de la shell
+    int fds[5] = {
+        l->fd_entrada >= 0 ? l->fd_entrada : STDIN_FILENO,
+        l->fd_salida >= 0 ? l->fd_salida : STDOUT_FILENO,
+        l->fd_error >= 0 ? l->fd_error : STDERR_FILENO,
+    };
+    int nfds = 3;
+    if (l->primer_plano) {
+        p.primer_plano = 1;
+        fds[nfds++] = STDIN_FILENO;
+    }
+    int cwd = -1;
+    if (estado_sucio && (cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+        p.con_estado = 1;
+        p.mascara = umask(0);
+        umask(p.mascara);
+        fds[nfds++] = cwd;
+    }
+    memcpy(buf, &p, sizeof(p));
+
+    union {
+        char datos[CMSG_SPACE(5 * sizeof(int))];
+        struct cmsghdr alineacion;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {buf, n};
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.datos, .msg_controllen = CMSG_SPACE(nfds * sizeof(int)),
+    };
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+
+    tRespuesta r;
+    ssize_t enviado;
+    while ((enviado = sendmsg(zygote_fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+    ssize_t recibido = -1;
+    if (enviado >= 0) {
+        while ((recibido = recv(zygote_fd, &r, sizeof(r), 0)) < 0 && errno == EINTR);
+    }
+    if (cwd >= 0) close(cwd);
+
+    if (recibido != (ssize_t)sizeof(r)) {
+        // El zygote ha muerto: a partir de aqui todo va por posix_spawn
+        fprintf(stderr, "msh: el zygote no responde; se usa posix_spawn\n");
+        close(zygote_fd);
+        zygote_fd = -1;
+        return lanzar_posix(l, ruta);
+    }
+    if (p.con_estado) {
+        estado_sucio = 0;
+    }
+    if (r.pid < 0) {
+        fprintf(stderr, "%s: Error. %s\n", l->argv[0], strerror(r.error));
+        return -1;
+    }
+    setpgid(r.pid, l->pgid ? l->pgid : r.pid);
+    return r.pid;
+}